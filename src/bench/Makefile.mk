@@ -0,0 +1,25 @@
+MAINTAINERCLEANFILES += \
+src/bench/*.gc{no,da}
+
+check_PROGRAMS += \
+src/bench/json_bench \
+src/bench/json_bench_scalar
+
+src_bench_json_bench_SOURCES = \
+src/bench/json_bench.c \
+src/bin/json.c \
+src/bin/smman.h
+src_bench_json_bench_CPPFLAGS = @BIN_CFLAGS@ $(EXTRA_CPPFLAGS) \
+-I$(top_srcdir)/src/bin
+src_bench_json_bench_LDFLAGS = @BIN_LIBS@
+
+src_bench_json_bench_scalar_SOURCES = $(src_bench_json_bench_SOURCES)
+src_bench_json_bench_scalar_CPPFLAGS = $(src_bench_json_bench_CPPFLAGS) \
+-DJSON_SCALAR
+src_bench_json_bench_scalar_LDFLAGS = @BIN_LIBS@
+
+.PHONY: bench
+
+bench: src/bench/json_bench src/bench/json_bench_scalar
+	@src/bench/json_bench
+	@src/bench/json_bench_scalar
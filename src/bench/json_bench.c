@@ -0,0 +1,155 @@
+/*
+ * Benchmark of json_append_escaped() on fixed corpora.
+ * Built twice, with SSE2 when the compiler has it and with JSON_SCALAR,
+ * both printing the same hash of their output when they agree.
+ */
+#include "smman.h"
+#include <time.h>
+
+#define BENCH_SIZE (900 * 1024)
+#define BENCH_ROUNDS 200
+
+#if (defined(__SSE2__)) && (!defined(JSON_SCALAR))
+# define BENCH_PATH "sse2"
+#else
+# define BENCH_PATH "scalar"
+#endif
+
+static const char _bench_base64[] =
+   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char *_bench_lines[] =
+{
+   "Oct 19 07:26:17 web01 sshd[4242]: Accepted publickey for deploy from "
+   "10.0.0.12 port 52144 ssh2: RSA SHA256:0bJ1q2rQx+7mZ\n",
+   "Oct 19 07:26:18 web01 app[77]: {\"user\":\"jos\xc3\xa9\",\"path\":"
+   "\"C:\\\\temp\\\\x\",\"msg\":\"caf\xc3\xa9 \xe2\x82\xac\"}\n",
+   "Oct 19 07:26:18 web01 kernel: \tcall trace:\x01 \xff\xfe broken\n",
+   "Oct 19 07:26:19 web01 nginx: 10.0.0.7 - - \"GET /index.html HTTP/1.1\" "
+   "200 612 \"-\" \"curl/8.5.0\"\n"
+};
+
+static unsigned int _bench_seed = 42;
+
+static void
+_bench_corpus_base64(char *s,
+                     size_t len)
+{
+   size_t i;
+
+   for (i = 0; i < len; i++)
+     {
+        _bench_seed = _bench_seed * 1103515245 + 12345;
+        s[i] = _bench_base64[(_bench_seed >> 16) & 63];
+     }
+}
+
+static void
+_bench_corpus_syslog(char *s,
+                     size_t len)
+{
+   size_t i = 0,
+          n;
+   unsigned int line = 0;
+
+   while (i < len)
+     {
+        n = strlen(_bench_lines[line]);
+        if (n > len - i)
+          n = len - i;
+        memcpy(s + i, _bench_lines[line], n);
+        i += n;
+        line = (line + 1) % (sizeof(_bench_lines) / sizeof(_bench_lines[0]));
+     }
+}
+
+static uint64_t
+_bench_hash(const char *s,
+            size_t len)
+{
+   uint64_t h = 0xcbf29ce484222325ULL;
+   size_t i;
+
+   for (i = 0; i < len; i++)
+     {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3ULL;
+     }
+   return h;
+}
+
+static double
+_bench_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Eina_Bool
+_bench_run(const char *name,
+           const char *s,
+           size_t len)
+{
+   Json_Buf jb = { 0 };
+   double start,
+          elapsed;
+   unsigned int i;
+
+   start = _bench_now();
+   for (i = 0; i < BENCH_ROUNDS; i++)
+     {
+        json_reset(&jb);
+        json_append_escaped(&jb, s, len);
+     }
+   elapsed = _bench_now() - start;
+
+   if (jb.error)
+     {
+        fprintf(stderr, "%s : failed to escape corpus\n", name);
+        free(jb.s);
+        return EINA_FALSE;
+     }
+
+   printf("%-6s %-7s %8.1f MB/s  %zu -> %zu bytes  hash %016llx\n",
+          BENCH_PATH, name,
+          (double)len * BENCH_ROUNDS / elapsed / (1024 * 1024),
+          len, jb.len, (unsigned long long)_bench_hash(jb.s, jb.len));
+   free(jb.s);
+   return EINA_TRUE;
+}
+
+int
+main(void)
+{
+   char *s;
+   int ret = 1;
+
+   eina_init();
+   smman_log_dom_global = eina_log_domain_register("json_bench",
+                                                   EINA_COLOR_CYAN);
+
+   s = malloc(BENCH_SIZE);
+   if (!s)
+     {
+        fprintf(stderr, "Failed to allocate corpus\n");
+        goto end;
+     }
+
+   _bench_corpus_base64(s, BENCH_SIZE);
+   if (!_bench_run("base64", s, BENCH_SIZE))
+     goto end;
+
+   _bench_corpus_syslog(s, BENCH_SIZE);
+   if (!_bench_run("syslog", s, BENCH_SIZE))
+     goto end;
+
+   ret = 0;
+
+end:
+   free(s);
+   eina_log_domain_unregister(smman_log_dom_global);
+   eina_shutdown();
+   return ret;
+}
@@ -7,8 +7,14 @@ src/bin/smman
 src_bin_smman_SOURCES = \
 src/bin/main.c \
 src/bin/config.c \
+src/bin/dedup.c \
 src/bin/filter.c \
+src/bin/json.c \
 src/bin/log.c \
+src/bin/route.c \
+src/bin/syslog.c \
+src/bin/template.c \
+src/bin/timestamp.c \
 src/bin/utils.c \
 src/bin/smman.h
 src_bin_smman_CPPFLAGS = @BIN_CFLAGS@ $(EXTRA_CPPFLAGS)
@@ -17,6 +23,5 @@ src_bin_smman_LDADD = \
 src/lib/libconf.la \
 src/lib/librules.la \
 src/lib/libspy.la \
-src/lib/libstore.la \
-src/lib/libcjson.la
+src/lib/libstore.la
 
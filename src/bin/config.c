@@ -1,4 +1,5 @@
 #include "smman.h"
+#include <ctype.h>
 
 void
 config_done(void *data,
@@ -6,9 +7,12 @@ config_done(void *data,
 {
    Smman *smman;
    Eina_Iterator *it;
-   char *s;
+   char *s,
+        **servers;
+   unsigned int i;
 
    smman = data;
+   smman->cfg.output.nodelay = EINA_TRUE;
 
    it = eina_hash_iterator_tuple_new(conf_variables_get(conf));
    while (eina_iterator_next(it, &data))
@@ -24,19 +28,184 @@ config_done(void *data,
           smman->cfg.server = strdup(value);
         else if (!strcmp("host", variable))
           smman->cfg.host = strdup(value);
+        else if (!strcmp("summary_interval", variable))
+          smman->cfg.summary_interval = strtod(value, NULL);
+        else if (!strcmp("bulk_max_docs", variable))
+          smman->cfg.bulk.max_docs = strtoul(value, NULL, 10);
+        else if (!strcmp("bulk_max_bytes", variable))
+          smman->cfg.bulk.max_bytes = strtoul(value, NULL, 10);
+        else if (!strcmp("bulk_linger", variable))
+          smman->cfg.bulk.linger = strtod(value, NULL);
+        else if (!strcmp("max_inflight", variable))
+          smman->cfg.max_inflight = strtoul(value, NULL, 10);
+        else if (!strcmp("priority_max_docs", variable))
+          smman->cfg.priority.max_docs = strtoul(value, NULL, 10);
+        else if (!strcmp("priority_linger", variable))
+          smman->cfg.priority.linger = strtod(value, NULL);
+        else if (!strcmp("priority_inflight", variable))
+          smman->cfg.priority.max_inflight = strtoul(value, NULL, 10);
+        else if (!strcmp("adaptive_latency", variable))
+          smman->cfg.adapt_latency = strtod(value, NULL);
+        else if (!strcmp("max_bytes_per_sec", variable))
+          smman->cfg.rate.max = strtod(value, NULL);
+        else if (!strcmp("endpoint_max_bytes_per_sec", variable))
+          smman->cfg.rate.endpoint_max = strtod(value, NULL);
+        else if (!strcmp("retry_attempts", variable))
+          smman->cfg.retry.attempts = strtoul(value, NULL, 10);
+        else if (!strcmp("retry_delay", variable))
+          smman->cfg.retry.delay = strtod(value, NULL);
+        else if (!strcmp("retry_max_delay", variable))
+          smman->cfg.retry.max_delay = strtod(value, NULL);
+        else if (!strcmp("compression", variable))
+          smman->cfg.compress.type = (!strcmp(value, "gzip")) ?
+             STORE_COMPRESS_GZIP : STORE_COMPRESS_NONE;
+        else if (!strcmp("compression_level", variable))
+          smman->cfg.compress.level = atoi(value);
+        else if (!strcmp("index", variable))
+          smman->routes.def = route_index_get(smman, value);
+        else if ((!strncmp("index.", variable, 6)) && (variable[6]))
+          {
+             if (!route_tag_add(smman, variable + 6, value))
+               ERR("Failed to route tag %s", variable + 6);
+          }
+        else if (!strcmp("output", variable))
+          {
+             if (!strcmp(value, "file"))
+               smman->cfg.output.cls = &store_sink_file;
+             else if (!strcmp(value, "stdout"))
+               smman->cfg.output.cls = &store_sink_stdout;
+             else if (!strcmp(value, "native"))
+               smman->cfg.output.cls = &store_sink_native;
+             else
+               smman->cfg.output.cls = &store_sink_http;
+          }
+        else if (!strcmp("output_path", variable))
+          smman->cfg.output.path = strdup(value);
+        else if (!strcmp("output_max_bytes", variable))
+          smman->cfg.output.max_bytes = strtoull(value, NULL, 10);
+        else if (!strcmp("output_max_age", variable))
+          smman->cfg.output.max_age = strtod(value, NULL);
+        else if (!strcmp("output_sync_interval", variable))
+          smman->cfg.output.sync_interval = strtod(value, NULL);
+        else if (!strcmp("http_nodelay", variable))
+          smman->cfg.output.nodelay = (strcmp(value, "no")) &&
+                                      (strcmp(value, "0"));
+        else if (!strcmp("http_keepalive", variable))
+          smman->cfg.output.keepalive = strtod(value, NULL);
+        else if (!strcmp("spool_dir", variable))
+          smman->cfg.spool.dir = strdup(value);
+        else if (!strcmp("spool_max_bytes", variable))
+          smman->cfg.spool.max_bytes = strtoull(value, NULL, 10);
+        else if (!strcmp("spool_policy", variable))
+          smman->cfg.spool.policy = (!strcmp(value, "backpressure")) ?
+             STORE_SPOOL_BACKPRESSURE : STORE_SPOOL_DROP_OLDEST;
+        else if (!strcmp("spool_replay_rate", variable))
+          smman->cfg.spool.replay_rate = strtod(value, NULL);
+        else if (!strcmp("high_water_bytes", variable))
+          smman->cfg.watermarks.high_bytes = strtoull(value, NULL, 10);
+        else if (!strcmp("low_water_bytes", variable))
+          smman->cfg.watermarks.low_bytes = strtoull(value, NULL, 10);
+        else if (!strcmp("high_water_batches", variable))
+          smman->cfg.watermarks.high_batches = strtoul(value, NULL, 10);
+        else if (!strcmp("low_water_batches", variable))
+          smman->cfg.watermarks.low_batches = strtoul(value, NULL, 10);
      }
 
+   if (smman->cfg.summary_interval <= 0.0)
+     smman->cfg.summary_interval = 60.0;
+
+   if (!smman->cfg.output.cls)
+     smman->cfg.output.cls = &store_sink_http;
+
+   DBG("Output = %s", smman->cfg.output.cls->name);
    DBG("Server = %s", smman->cfg.server);
    DBG("Host = %s", smman->cfg.host);
+   DBG("Summary interval = %f", smman->cfg.summary_interval);
    eina_iterator_free(it);
 
-   s = sdupf("%s%s%s",
-             smman->cfg.server,
-             (smman->cfg.server[strlen(smman->cfg.server)-1] == '/') ?
-                "" : "/",
-             "logs/");
-   smman->store = store_new(s);
-   free(s);
+   if ((smman->cfg.output.cls != &store_sink_http) &&
+       (smman->cfg.output.cls != &store_sink_native))
+     {
+        smman->store = store_sink_new(smman->cfg.output.cls,
+                                      smman->cfg.output.path);
+        goto store_setup;
+     }
+
+   if (!smman->cfg.server)
+     goto store_setup;
+
+   servers = eina_str_split(smman->cfg.server, ",", 0);
+   for (i = 0; servers[i]; i++)
+     {
+        const char *server = servers[i];
+        size_t len;
+
+        while (isspace((unsigned char)*server))
+          server++;
+        len = strlen(server);
+        while ((len) && (isspace((unsigned char)server[len - 1])))
+          len--;
+        if (!len)
+          continue;
+
+        s = sdupf("%.*s%s%s", (int)len, server,
+                  (server[len - 1] == '/') ? "" : "/", "logs/");
+        if (!smman->store)
+          smman->store = store_sink_new(smman->cfg.output.cls, s);
+        else if (smman->cfg.output.cls == &store_sink_native)
+          WRN("Native client only sends to the first server, not %s", s);
+        else if (!store_endpoint_add(smman->store, s))
+          ERR("Failed to add server %s", s);
+        free(s);
+     }
+   free(servers[0]);
+   free(servers);
+
+store_setup:
+   if (!smman->store)
+     {
+        ERR("Failed to create %s output", smman->cfg.output.cls->name);
+        ecore_main_loop_quit();
+        return;
+     }
+
+   if (smman->cfg.output.cls == &store_sink_file)
+     store_file_set(smman->store, smman->cfg.output.max_bytes,
+                    smman->cfg.output.max_age,
+                    smman->cfg.output.sync_interval);
+   else if (smman->cfg.output.cls == &store_sink_native)
+     store_native_set(smman->store, smman->cfg.output.nodelay,
+                      smman->cfg.output.keepalive);
+   store_batch_set(smman->store, smman->cfg.bulk.max_docs,
+                   smman->cfg.bulk.max_bytes, smman->cfg.bulk.linger);
+   store_inflight_set(smman->store, smman->cfg.max_inflight);
+   store_adapt_set(smman->store, smman->cfg.adapt_latency);
+   store_rate_set(smman->store, smman->cfg.rate.max,
+                  smman->cfg.rate.endpoint_max);
+   store_priority_set(smman->store, smman->cfg.priority.max_docs,
+                      smman->cfg.priority.linger,
+                      smman->cfg.priority.max_inflight);
+   store_retry_set(smman->store, smman->cfg.retry.attempts,
+                   smman->cfg.retry.delay, smman->cfg.retry.max_delay);
+   store_compress_set(smman->store, smman->cfg.compress.type,
+                      smman->cfg.compress.level);
+   store_watermarks_set(smman->store,
+                        smman->cfg.watermarks.high_bytes,
+                        smman->cfg.watermarks.low_bytes,
+                        smman->cfg.watermarks.high_batches,
+                        smman->cfg.watermarks.low_batches);
+   store_throttle_callback_set(smman->store, filter_throttle, smman);
+
+   if (!smman->cfg.spool.max_bytes)
+     smman->cfg.spool.max_bytes = 1024 * 1024 * 1024;
+   if ((smman->cfg.spool.dir) &&
+       (!store_spool_set(smman->store, smman->cfg.spool.dir,
+                         smman->cfg.spool.max_bytes, smman->cfg.spool.policy,
+                         smman->cfg.spool.replay_rate)))
+     ERR("Failed to set spool in %s", smman->cfg.spool.dir);
+
+   smman->summary = ecore_timer_loop_add(smman->cfg.summary_interval,
+                                         log_summary, smman);
 }
 
 void
@@ -0,0 +1,119 @@
+#include "smman.h"
+
+static void
+_dedup_entry_flush(Smman *smman,
+                   Filter *filter,
+                   Dedup_Entry *e)
+{
+   Log_Field fields[3];
+   char first[TIMESTAMP_LEN + 1],
+        last[TIMESTAMP_LEN + 1];
+
+   if (!e->repeats)
+     goto entry_reset;
+
+   DBG("filter[%p][%s] collapsed %lu lines", filter, filter->filename,
+       e->repeats);
+
+   timestamp_fill(first, e->first);
+   timestamp_fill(last, e->last);
+
+   memset(fields, 0, sizeof(fields));
+   fields[0].name = "repeat_count";
+   fields[0].num = e->repeats;
+   fields[1].name = "first_timestamp";
+   fields[1].s = first;
+   fields[2].name = "last_timestamp";
+   fields[2].s = last;
+
+   log_repeat_send(smman, filter, e->id, e->message, fields, 3);
+
+entry_reset:
+   free(e->message);
+   memset(e, 0, sizeof(Dedup_Entry));
+}
+
+Eina_Bool
+dedup_line(Smman *smman,
+           Filter *filter,
+           Spy_Line *sl)
+{
+   Dedup_Entry *e;
+   uint64_t hash;
+   double now;
+
+   now = ecore_loop_time_get();
+   hash = spy_line_hash_get(sl);
+   e = &filter->dedup.slots[hash & (DEDUP_SLOTS - 1)];
+
+   if ((e->start > 0.0) && (e->hash == hash) &&
+       (now - e->start <= filter->dedup.window) &&
+       ((!e->message) || (!strcmp(e->message, spy_line_get(sl)))))
+     {
+        if (!e->message)
+          {
+             e->message = strdup(spy_line_get(sl));
+             e->first = ecore_time_unix_get();
+             spy_line_id_get(sl, e->id);
+          }
+        e->last = ecore_time_unix_get();
+        e->repeats++;
+        return EINA_TRUE;
+     }
+
+   _dedup_entry_flush(smman, filter, e);
+   e->hash = hash;
+   e->start = now;
+   return EINA_FALSE;
+}
+
+void
+dedup_flush(Smman *smman,
+            Filter *filter,
+            Eina_Bool all)
+{
+   Dedup_Entry *e;
+   double now;
+   unsigned int i;
+
+   if (!filter->dedup.slots)
+     return;
+
+   now = ecore_loop_time_get();
+   for (i = 0; i < DEDUP_SLOTS; i++)
+     {
+        e = &filter->dedup.slots[i];
+        if (e->start <= 0.0)
+          continue;
+
+        if ((all) || (now - e->start > filter->dedup.window))
+          _dedup_entry_flush(smman, filter, e);
+     }
+}
+
+void
+dedup_setup(Filter *filter)
+{
+   if ((filter->dedup.window > 0.0) && (!filter->dedup.slots))
+     {
+        DBG("Collapsing repeated lines of %s within %f seconds",
+            filter->filename, filter->dedup.window);
+        filter->dedup.slots = calloc(DEDUP_SLOTS, sizeof(Dedup_Entry));
+     }
+   else if ((filter->dedup.window <= 0.0) && (filter->dedup.slots))
+     {
+        free(filter->dedup.slots);
+        filter->dedup.slots = NULL;
+     }
+}
+
+Eina_Bool
+dedup_timer(void *data)
+{
+   Smman *smman = data;
+   Filter *filter;
+
+   EINA_INLIST_FOREACH(smman->filters, filter)
+     dedup_flush(smman, filter, EINA_FALSE);
+   return EINA_TRUE;
+}
@@ -6,6 +6,39 @@ _filter_rules_free(void *data EINA_UNUSED)
 {
 }
 
+static void
+_filter_programs_free(void *data)
+{
+   eina_list_free(data);
+}
+
+static void
+_filter_dispatch_reset(Filter *filter)
+{
+   if (filter->dispatch.programs)
+     eina_hash_free(filter->dispatch.programs);
+   filter->dispatch.programs = eina_hash_string_superfast_new(_filter_programs_free);
+   filter->dispatch.generic = eina_list_free(filter->dispatch.generic);
+}
+
+static void
+_filter_dispatch_add(Filter *filter,
+                     Rule *rule)
+{
+   Eina_List *l;
+
+   if (!rule->spec.program)
+     {
+        filter->dispatch.generic = eina_list_append(filter->dispatch.generic,
+                                                    rule);
+        return;
+     }
+
+   l = eina_hash_find(filter->dispatch.programs, rule->spec.program);
+   l = eina_list_append(l, rule);
+   eina_hash_set(filter->dispatch.programs, rule->spec.program, l);
+}
+
 Eina_Bool
 filter_reload(void *data,
               int type EINA_UNUSED,
@@ -16,14 +49,23 @@ filter_reload(void *data,
 
    DBG("smman[%p]", smman);
 
+   /* Report suppressed lines before counters get freed with the rules */
+   log_summary(smman);
+
    EINA_INLIST_FOREACH(smman->filters, filter)
      {
         spy_file_pause(filter->sf);
+        dedup_flush(smman, filter, EINA_TRUE);
+        filter->dedup.window = 0.0;
+        template_purge(filter);
         eina_hash_free(filter->rules);
         filter->rules = eina_hash_string_superfast_new(_filter_rules_free);
+        _filter_dispatch_reset(filter);
      }
 
    rules_purge(smman->rules);
+   log_tags_purge(smman);
+   route_tags_reset(smman);
 
    rules_load(smman->rules, filter_load, filter_load_done,
               filter_load_error, smman);
@@ -67,6 +109,12 @@ filter_load(void *data,
        rule->name, rule->spec.filename, rule->spec.source_host,
        rule->spec.source_path, (rule->spec.todel) ? "EINA_TRUE" : "EINA_FALSE");
 
+   if ((rule->spec.index) && (!route_index_get(smman, rule->spec.index)))
+     {
+        free((char *)rule->spec.index);
+        rule->spec.index = NULL;
+     }
+
    /* Loop with globbing to write here! */
    r = glob(rule->spec.filename, GLOB_MARK, 0, &files);
    if (r)
@@ -95,8 +143,13 @@ filter_load(void *data,
           }
 
         spy_file_data_set(filter->sf, filter);
+        /* Balanced by filter_load_done(), on top of throttling */
+        spy_file_pause(filter->sf);
+        if (smman->throttled)
+          spy_file_pause(filter->sf);
         filter->filename = strdup(*s);
         filter->rules = eina_hash_string_superfast_new(_filter_rules_free);
+        _filter_dispatch_reset(filter);
         smman->filters = eina_inlist_append(smman->filters,
                                             EINA_INLIST_GET(filter));
 
@@ -104,10 +157,45 @@ filter_load(void *data,
         DBG("Adding rule[%p][%s] to filter[%p][%s]",
             rule, rule->name, filter, filter->filename);
         eina_hash_add(filter->rules, rule->name, rule);
+        _filter_dispatch_add(filter, rule);
+        if (rule->spec.dedup > filter->dedup.window)
+          filter->dedup.window = rule->spec.dedup;
      }
    globfree(&files);
 }
 
+/* Lines keep the fields of LOG_TEMPLATE_RULES matching rules at most */
+static void
+_filter_fields_check(Filter *filter)
+{
+   Eina_Iterator *it;
+   Eina_List *programs,
+             *l;
+   Rule *rule;
+   unsigned int generic = 0,
+                n;
+
+   EINA_LIST_FOREACH(filter->dispatch.generic, l, rule)
+     {
+        if ((rule->spec.fields) && (generic++ >= LOG_TEMPLATE_RULES))
+          WRN("Too many rules with fields for %s, fields of %s may be ignored",
+              filter->filename, rule->name);
+     }
+
+   it = eina_hash_iterator_data_new(filter->dispatch.programs);
+   while (eina_iterator_next(it, (void **)&programs))
+     {
+        n = generic;
+        EINA_LIST_FOREACH(programs, l, rule)
+          {
+             if ((rule->spec.fields) && (n++ >= LOG_TEMPLATE_RULES))
+               WRN("Too many rules with fields for %s, fields of %s may be "
+                   "ignored", filter->filename, rule->name);
+          }
+     }
+   eina_iterator_free(it);
+}
+
 void
 filter_load_done(void *data,
                  Rules *rules)
@@ -126,6 +214,8 @@ filter_load_done(void *data,
      {
         if (eina_hash_population(filter->rules))
           {
+             dedup_setup(filter);
+             _filter_fields_check(filter);
              DBG("Resuming sf[%p]", filter->sf);
              spy_file_resume(filter->sf);
              continue;
@@ -134,12 +224,37 @@ filter_load_done(void *data,
         DBG("Freeing filter %s", filter->filename);
         smman->filters = eina_inlist_remove(smman->filters, smman->filters);
         spy_file_free(filter->sf);
+        free(filter->dedup.slots);
+        template_purge(filter);
         free((char *)filter->filename);
         eina_hash_free(filter->rules);
+        eina_hash_free(filter->dispatch.programs);
+        eina_list_free(filter->dispatch.generic);
         free(filter);
      }
 }
 
+void
+filter_throttle(void *data,
+                Store *store EINA_UNUSED,
+                Eina_Bool throttled)
+{
+   Smman *smman = data;
+   Filter *filter;
+
+   DBG("smman[%p] throttled[%d]", smman, throttled);
+
+   /* Unread lines stay in the files until store catches up */
+   smman->throttled = throttled;
+   EINA_INLIST_FOREACH(smman->filters, filter)
+     {
+        if (throttled)
+          spy_file_pause(filter->sf);
+        else
+          spy_file_resume(filter->sf);
+     }
+}
+
 void
 filter_load_error(void *data,
                   Rules *rules,
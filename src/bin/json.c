@@ -0,0 +1,270 @@
+#include "smman.h"
+#include <math.h>
+
+/* JSON_SCALAR only builds the portable loop, to benchmark it */
+#if (defined(__SSE2__)) && (!defined(JSON_SCALAR))
+# define JSON_SSE2
+# include <emmintrin.h>
+#endif
+
+#define JSON_BUF_MIN 4096
+
+static const char _json_hex[] = "0123456789abcdef";
+
+Eina_Bool
+json_reserve(Json_Buf *jb,
+             size_t len)
+{
+   size_t size;
+   char *s;
+
+   if (jb->len + len + 1 <= jb->size)
+     return EINA_TRUE;
+
+   size = (jb->size) ? jb->size : JSON_BUF_MIN;
+   while (size < jb->len + len + 1)
+     size *= 2;
+
+   s = realloc(jb->s, size);
+   if (!s)
+     {
+        ERR("Failed to grow JSON buffer to %zu bytes", size);
+        jb->error = EINA_TRUE;
+        return EINA_FALSE;
+     }
+
+   jb->s = s;
+   jb->size = size;
+   return EINA_TRUE;
+}
+
+void
+json_reset(Json_Buf *jb)
+{
+   jb->len = 0;
+   jb->error = EINA_FALSE;
+   if (jb->s)
+     jb->s[0] = 0;
+}
+
+void
+json_append(Json_Buf *jb,
+            const char *s,
+            size_t len)
+{
+   if (!json_reserve(jb, len))
+     return;
+
+   memcpy(jb->s + jb->len, s, len);
+   jb->len += len;
+   jb->s[jb->len] = 0;
+}
+
+/*
+ * Length of the valid UTF-8 sequence starting at p, 0 if it is invalid
+ * (overlong encodings, surrogates and code points above U+10FFFF are
+ * rejected).
+ */
+static size_t
+_json_utf8_len(const unsigned char *p,
+               const unsigned char *end)
+{
+   unsigned char lo = 0x80,
+                 hi = 0xbf;
+   size_t len,
+          i;
+
+   if ((*p >= 0xc2) && (*p <= 0xdf))
+     len = 2;
+   else if ((*p >= 0xe0) && (*p <= 0xef))
+     {
+        len = 3;
+        if (*p == 0xe0) lo = 0xa0;
+        else if (*p == 0xed) hi = 0x9f;
+     }
+   else if ((*p >= 0xf0) && (*p <= 0xf4))
+     {
+        len = 4;
+        if (*p == 0xf0) lo = 0x90;
+        else if (*p == 0xf4) hi = 0x8f;
+     }
+   else
+     return 0;
+
+   if ((size_t)(end - p) < len)
+     return 0;
+
+   if ((p[1] < lo) || (p[1] > hi))
+     return 0;
+
+   for (i = 2; i < len; i++)
+     if ((p[i] & 0xc0) != 0x80)
+       return 0;
+
+   return len;
+}
+
+/*
+ * Writes the escaped form of the byte (or UTF-8 sequence) at p.
+ * Invalid UTF-8 bytes are replaced by U+FFFD, so ES does not reject
+ * the whole request.
+ */
+static const unsigned char *
+_json_escape_special(const unsigned char *p,
+                     const unsigned char *end,
+                     char **dst)
+{
+   char *d = *dst;
+   size_t len;
+
+   if (*p >= 0x80)
+     {
+        len = _json_utf8_len(p, end);
+        if (len)
+          {
+             memcpy(d, p, len);
+             *dst = d + len;
+             return p + len;
+          }
+
+        *d++ = (char)0xef;
+        *d++ = (char)0xbf;
+        *d++ = (char)0xbd;
+        *dst = d;
+        return p + 1;
+     }
+
+   *d++ = '\\';
+   switch (*p)
+     {
+      case '"': *d++ = '"'; break;
+      case '\\': *d++ = '\\'; break;
+      case '\b': *d++ = 'b'; break;
+      case '\f': *d++ = 'f'; break;
+      case '\n': *d++ = 'n'; break;
+      case '\r': *d++ = 'r'; break;
+      case '\t': *d++ = 't'; break;
+      default:
+        *d++ = 'u';
+        *d++ = '0';
+        *d++ = '0';
+        *d++ = _json_hex[*p >> 4];
+        *d++ = _json_hex[*p & 0xf];
+     }
+   *dst = d;
+   return p + 1;
+}
+
+static inline Eina_Bool
+_json_is_special(unsigned char c)
+{
+   return ((c < 0x20) || (c == '"') || (c == '\\') || (c >= 0x80));
+}
+
+/*
+ * Appends s, escaped for being put inside of a JSON string.
+ * With SSE2, 16 bytes are checked at once and clean runs are copied
+ * as is, only bytes needing an escape or UTF-8 validation are handled
+ * one by one.
+ */
+void
+json_append_escaped(Json_Buf *jb,
+                    const char *s,
+                    size_t len)
+{
+   const unsigned char *p = (const unsigned char *)s,
+                       *end = p + len;
+   char *d;
+
+   /* Worst case is \u00XX for every byte */
+   if (!json_reserve(jb, len * 6))
+     return;
+
+   d = jb->s + jb->len;
+
+#ifdef JSON_SSE2
+   {
+      const __m128i quote = _mm_set1_epi8('"'),
+                    backslash = _mm_set1_epi8('\\'),
+                    space = _mm_set1_epi8(0x20),
+                    sign = _mm_set1_epi8((char)0x80);
+
+      while (end - p >= 16)
+        {
+           __m128i v,
+                   m;
+           int mask;
+
+           v = _mm_loadu_si128((const __m128i *)p);
+
+           /* SSE2 only compares signed bytes : c < 0x20 is checked with
+            * the sign bits flipped, and c >= 0x80 is c < 0 */
+           m = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                            _mm_cmpeq_epi8(v, backslash));
+           m = _mm_or_si128(m, _mm_cmplt_epi8(_mm_xor_si128(v, sign),
+                                             _mm_xor_si128(space, sign)));
+           m = _mm_or_si128(m, _mm_cmplt_epi8(v, _mm_setzero_si128()));
+           mask = _mm_movemask_epi8(m);
+
+           if (!mask)
+             {
+                _mm_storeu_si128((__m128i *)d, v);
+                d += 16;
+                p += 16;
+                continue;
+             }
+
+           mask = __builtin_ctz(mask);
+           memcpy(d, p, mask);
+           d += mask;
+           p = _json_escape_special(p + mask, end, &d);
+        }
+   }
+#endif
+
+   while (p != end)
+     {
+        if (!_json_is_special(*p))
+          {
+             *d++ = *p++;
+             continue;
+          }
+        p = _json_escape_special(p, end, &d);
+     }
+
+   jb->len = d - jb->s;
+   jb->s[jb->len] = 0;
+}
+
+void
+json_append_string(Json_Buf *jb,
+                   const char *s)
+{
+   json_append_literal(jb, "\"");
+   if (s)
+     json_append_escaped(jb, s, strlen(s));
+   json_append_literal(jb, "\"");
+}
+
+void
+json_append_number(Json_Buf *jb,
+                   double d)
+{
+   int len;
+
+   /* JSON has no NaN nor infinity */
+   if (!isfinite(d))
+     {
+        json_append_literal(jb, "null");
+        return;
+     }
+
+   if (!json_reserve(jb, 32))
+     return;
+
+   if ((d < 1e15) && (d > -1e15) && (d == (double)(long long)d))
+     len = snprintf(jb->s + jb->len, 32, "%lld", (long long)d);
+   else
+     len = snprintf(jb->s + jb->len, 32, "%.17g", d);
+   jb->len += len;
+}
@@ -1,13 +1,32 @@
 #include "smman.h"
 
+/*
+ * Lives on the stack for the time of one line, strings are borrowed :
+ * message from the Spy_Line, the others from the config, the filter or
+ * the rules, which outlive it.
+ */
 typedef struct _Log
 {
    const char *filename,
               *source_host,
               *source_path,
-              *message;
-   Eina_List *tags;
-   Eina_Bool todel;
+              *message,
+              *index; /* Index pattern of the last matching rule having one */
+   Filter *filter;
+   Rule_Tags tags;
+   const Log_Field *fields;
+   unsigned int fields_count;
+   Rule *field_rules[LOG_TEMPLATE_RULES]; /* Matching rules having fields */
+   unsigned int field_rules_count;
+   double timestamp; /* When the event happened, 0 if unknown */
+   const char *id; /* Document id, NULL for lines made by smman */
+   off_t offset; /* Position in file, for lines read from it */
+   unsigned long line;
+   Eina_Bool todel,
+             limited, /* A matching rule was skipped by sample or rate_limit */
+             matched, /* A matching rule was applied */
+             unlimited, /* Not subject to sample and rate_limit */
+             priority; /* A matching rule has priority = high */
 } Log;
 
 void
@@ -31,73 +50,132 @@ _log_error(void *data,
    ERR("smman[%p] Failed to store data :\n%s\n", smman, strerr);
 }
 
-void
-_log_send(Smman *smman,
-          Log *log)
+/* Escaped tags are built on first use, ids only grow until rules_purge() */
+static const Log_Tag *
+_log_tag_get(Smman *smman,
+             unsigned int id)
 {
-   cJSON *json,
-         *json_tags;
-   char *source,
-        *date,
-        *tag,
-        *s;
-   Eina_List *l;
+   Json_Buf jb = { NULL, 0, 0, EINA_FALSE };
+   const char *name;
 
-   json = cJSON_CreateObject();
-   if (!json)
+   while (smman->tags.count <= id)
      {
-        ERR("Failed to allocate JSON object");
-        return;
-     }
+        name = rules_tag_name_get(smman->rules, smman->tags.count);
+        if (!name)
+          return NULL;
 
-   source = sdupf("file://%s%s", smman->cfg.server, log->source_path);
-   EINA_SAFETY_ON_NULL_RETURN(source);
+        json_append_string(&jb, name);
+        if (jb.error)
+          {
+             free(jb.s);
+             return NULL;
+          }
 
-   date = date_es();
-   EINA_SAFETY_ON_NULL_RETURN(date);
+        smman->tags.table[smman->tags.count].s = jb.s;
+        smman->tags.table[smman->tags.count].len = jb.len;
+        smman->tags.count++;
+        memset(&jb, 0, sizeof(jb));
+     }
+   return &smman->tags.table[id];
+}
 
+void
+log_tags_purge(Smman *smman)
+{
+   while (smman->tags.count)
+     free(smman->tags.table[--smman->tags.count].s);
+}
 
-   cJSON_AddStringToObject(json, "@source", source);
-   cJSON_AddStringToObject(json, "@type", "syslog");
+void
+_log_send(Smman *smman,
+          Log *log)
+{
+   static Json_Buf jb;
+   Log_Template *tpl;
+   const Log_Tag *tag;
+   const char *index;
+   char date[TIMESTAMP_LEN + 1];
+   Eina_Bool first = EINA_TRUE,
+             comma;
+   unsigned int i;
+
+   tpl = template_get(smman, log->filter, log->source_host, log->source_path,
+                      log->field_rules, log->field_rules_count);
+   if (!tpl)
+     {
+        ERR("Failed to get event template");
+        return;
+     }
 
-   json_tags = cJSON_CreateArray();
-   cJSON_AddItemToObject(json, "@tags", json_tags);
+   json_reset(&jb);
+   json_append(&jb, tpl->prefix, tpl->prefix_len);
 
-   EINA_LIST_FOREACH(log->tags, l, tag)
+   comma = tpl->fields;
+   for (i = 0; i < log->fields_count; i++)
      {
-        cJSON_AddItemToArray(json_tags, cJSON_CreateString(tag));
+        if (comma)
+          json_append_literal(&jb, ",");
+        comma = EINA_TRUE;
+        json_append_string(&jb, log->fields[i].name);
+        json_append_literal(&jb, ":");
+        if (log->fields[i].s)
+          json_append_string(&jb, log->fields[i].s);
+        else
+          json_append_number(&jb, log->fields[i].num);
      }
 
-   cJSON_AddItemToObject(json, "@fields", cJSON_CreateObject());
+   if (log->line)
+     {
+        if (comma)
+          json_append_literal(&jb, ",");
+        json_append_literal(&jb, "\"offset\":");
+        json_append_number(&jb, log->offset);
+        json_append_literal(&jb, ",\"line\":");
+        json_append_number(&jb, log->line);
+     }
 
-   cJSON_AddStringToObject(json, "@message", log->message);
-   cJSON_AddStringToObject(json, "@timestamp", date);
-   cJSON_AddStringToObject(json, "@source_host", log->source_host);
-   cJSON_AddStringToObject(json, "@source_path", log->source_path);
+   json_append_literal(&jb, "},\"@tags\":[");
+   for (i = 0; i < RULES_TAGS_MAX / 64; i++)
+     {
+        uint64_t bits = log->tags.bits[i];
 
-   s = cJSON_Print(json);
+        while (bits)
+          {
+             tag = _log_tag_get(smman, i * 64 + __builtin_ctzll(bits));
+             bits &= bits - 1;
+             if (!tag)
+               continue;
+
+             if (!first)
+               json_append_literal(&jb, ",");
+             json_append(&jb, tag->s, tag->len);
+             first = EINA_FALSE;
+          }
+     }
 
-   store_add(smman->store, s, strlen(s), _log_done, _log_error, smman);
+   json_append_literal(&jb, "],\"@timestamp\":\"");
+   if (log->timestamp > 0.0)
+     json_append(&jb, date, timestamp_fill(date, log->timestamp));
+   else
+     json_append(&jb, date, timestamp_now(date));
 
-   free(s);
-   free(date);
-   free(source);
-   cJSON_Delete(json);
-}
-
-void
-_log_free(Log *log)
-{
-   char *tag;
+   json_append_literal(&jb, "\",\"@message\":");
+   json_append_string(&jb, log->message);
+   json_append_literal(&jb, "}");
 
-   eina_stringshare_replace(&log->filename, NULL);
-   eina_stringshare_replace(&log->source_host, NULL);
-   eina_stringshare_replace(&log->source_path, NULL);
-   eina_stringshare_replace(&log->message, NULL);
+   if (jb.error)
+     {
+        ERR("Failed to serialize event");
+        return;
+     }
 
-   EINA_LIST_FREE(log->tags, tag)
-     free(tag);
-   free(log);
+   index = route_index(smman, log->index, &log->tags, log->timestamp);
+   if (log->priority)
+     store_batch_priority_add(smman->store, index, log->id, jb.s, jb.len,
+                              _log_done, _log_error, smman);
+   else
+     store_batch_index_add(smman->store, index, log->id, jb.s, jb.len,
+                           _log_done, _log_error, smman);
 }
 
 Eina_Bool
@@ -122,66 +200,343 @@ _log_line_match(const char *log, Rule *rule)
    return (excluded) ? EINA_FALSE : EINA_TRUE;
 }
 
+/* Returns EINA_TRUE if sample or rate_limit of the rule skips the line */
+static Eina_Bool
+_log_line_limit(Rule *rule)
+{
+   double now,
+          burst;
+
+   rule->limit.seen++;
+
+   if ((rule->spec.sample > 1) &&
+       ((rule->limit.seen - 1) % rule->spec.sample))
+     goto limit_drop;
+
+   if (rule->spec.rate_limit <= 0.0)
+     return EINA_FALSE;
+
+   now = ecore_loop_time_get();
+   burst = (rule->spec.rate_limit < 1.0) ? 1.0 : rule->spec.rate_limit;
+
+   if (rule->limit.last > 0.0)
+     {
+        rule->limit.tokens += (now - rule->limit.last) * rule->spec.rate_limit;
+        if (rule->limit.tokens > burst)
+          rule->limit.tokens = burst;
+     }
+   rule->limit.last = now;
+
+   if (rule->limit.tokens < 1.0)
+     goto limit_drop;
+
+   rule->limit.tokens -= 1.0;
+   return EINA_FALSE;
+
+limit_drop:
+   rule->limit.suppressed++;
+   return EINA_TRUE;
+}
+
+void
+_log_summary_rule(Smman *smman,
+                  Filter *filter,
+                  Rule *rule)
+{
+   Log log;
+   Log_Field fields[4];
+   char *s;
+   int id;
+
+   if (!rule->limit.suppressed)
+     return;
+
+   memset(fields, 0, sizeof(fields));
+   memset(&log, 0, sizeof(Log));
+
+   s = sdupf("smman suppressed %lu lines matching rule %s",
+             rule->limit.suppressed, rule->name);
+   EINA_SAFETY_ON_NULL_RETURN(s);
+   log.message = s;
+   log.filename = filter->filename;
+   log.source_host = smman->cfg.host;
+   log.source_path = filter->filename;
+   log.filter = filter;
+   id = rules_tag_intern(smman->rules, "smman_suppressed");
+   if (id >= 0)
+     RULE_TAGS_SET(&log.tags, id);
+
+   fields[0].name = "rule";
+   fields[0].s = rule->name;
+   fields[1].name = "suppressed";
+   fields[1].num = rule->limit.suppressed;
+   log.fields_count = 2;
+   if (rule->spec.sample > 1)
+     {
+        fields[log.fields_count].name = "sample";
+        fields[log.fields_count++].num = rule->spec.sample;
+     }
+   if (rule->spec.rate_limit > 0.0)
+     {
+        fields[log.fields_count].name = "rate_limit";
+        fields[log.fields_count++].num = rule->spec.rate_limit;
+     }
+   log.fields = fields;
+
+   DBG("rule[%s] suppressed %lu lines", rule->name, rule->limit.suppressed);
+   rule->limit.suppressed = 0;
+
+   if (smman->store)
+     _log_send(smman, &log);
+   free(s);
+}
+
 Eina_Bool
-log_line_event(void *data,
-               int type EINA_UNUSED,
-               void *event)
+log_summary(void *data)
 {
    Smman *smman = data;
-   Spy_Line *sl = event;
-   Spy_File *sf = spy_line_spyfile_get(sl);
-   Filter *filter = spy_file_data_get(sf);
-   Log *log;
-   Rule *rule;
+   Filter *filter;
    Eina_Iterator *it;
-   Eina_Hash_Tuple *t;
-   Eina_Bool r;
-   const char *tag;
+   Rule *rule;
+   Store_Stats stats;
 
-   DBG("smman[%p] sl[%p][%s] filter[%p][%s]",
-       smman, sl, spy_file_name_get(sf), filter, filter->filename);
+   EINA_INLIST_FOREACH(smman->filters, filter)
+     {
+        it = eina_hash_iterator_data_new(filter->rules);
+        while (eina_iterator_next(it, (void **)&rule))
+          _log_summary_rule(smman, filter, rule);
+        eina_iterator_free(it);
+     }
 
-   log = calloc(1, sizeof(Log));
-   eina_stringshare_replace(&log->message, spy_line_get(sl));
-   eina_stringshare_replace(&log->filename, filter->filename);
-   eina_stringshare_replace(&log->source_host, smman->cfg.host);
-   eina_stringshare_replace(&log->source_path, filter->filename);
+   if (!smman->store)
+     return EINA_TRUE;
+
+   store_stats_get(smman->store, &stats);
+   NFO("store : %u/%u servers up, %u requests in flight, %u batches and "
+       "%zu bytes waiting, %zu bytes spooled, %lu dropped, throttled %s "
+       "(%lu times, %.1fs)",
+       stats.endpoints - stats.endpoints_down, stats.endpoints,
+       stats.inflight, stats.pending, stats.bytes, stats.spool_bytes,
+       stats.spool_dropped, (stats.throttled) ? "yes" : "no",
+       stats.throttled_count, stats.throttled_time);
+   if (stats.adaptive)
+     NFO("store : batches of %u documents or %zu bytes, lingering %.2fs, "
+         "%u requests in flight, %.3fs latency, %.6fs per document "
+         "(%lu increases, %lu decreases)",
+         stats.batch_docs, stats.batch_bytes, stats.batch_linger,
+         stats.max_inflight, stats.latency, stats.doc_cost,
+         stats.adapt_increases, stats.adapt_decreases);
+   if ((stats.rate_limit > 0.0) || (stats.endpoint_rate_limit > 0.0))
+     NFO("store : sending %.0f bytes/s, limited to %.0f bytes/s and %.0f "
+         "per server, %llu bytes sent, paced %lu times",
+         stats.rate, stats.rate_limit, stats.endpoint_rate_limit,
+         stats.bytes_sent, stats.paced);
+   return EINA_TRUE;
+}
 
-   /* Now we apply rules */
-   it = eina_hash_iterator_tuple_new(filter->rules);
-   while (eina_iterator_next(it, (void **)&t))
+static Eina_Bool
+_log_line_rule(Log *log,
+               Rule_Event *ev,
+               Rule *rule)
+{
+   if ((rule->spec.condition) &&
+       (!rules_condition_eval(rule->spec.condition, ev)))
+     return EINA_TRUE;
+
+   if (!_log_line_match(ev->line, rule))
+     return EINA_TRUE;
+
+   if (rule->spec.todel)
      {
-        Eina_List *l;
+        log->todel = EINA_TRUE;
+        return EINA_FALSE;
+     }
 
-        rule = t->data;
+   /* A limited rule only gives up its own tags, fields and settings */
+   if ((!log->unlimited) && (_log_line_limit(rule)))
+     {
+        log->limited = EINA_TRUE;
+        return EINA_TRUE;
+     }
+   log->matched = EINA_TRUE;
 
-        r = _log_line_match(spy_line_get(sl), rule);
-        if (!r)
-          continue;
+   if (rule->spec.source_host)
+     log->source_host = rule->spec.source_host;
 
-        if (rule->spec.todel)
-          {
-             log->todel = EINA_TRUE;
-             break;
-          }
+   if (rule->spec.source_path)
+     log->source_path = rule->spec.source_path;
+
+   if (rule->spec.index)
+     log->index = rule->spec.index;
+
+   if (rule->spec.priority)
+     log->priority = EINA_TRUE;
+
+   RULE_TAGS_MERGE(&log->tags, &rule->spec.tagset);
 
-        if (rule->spec.source_host)
-          eina_stringshare_replace(&log->source_host, rule->spec.source_host);
+   if (rule->spec.fields)
+     {
+        if (log->field_rules_count < LOG_TEMPLATE_RULES)
+          log->field_rules[log->field_rules_count++] = rule;
+        else
+          DBG("Too many rules with fields, ignoring fields of %s",
+              rule->name);
+     }
+   return EINA_TRUE;
+}
+
+/* Ids are the 128 bits hash of the line position, as 32 hex digits */
+static void
+_log_id_fill(char *s,
+             const uint64_t id[2])
+{
+   static const char hex[] = "0123456789abcdef";
+   unsigned int i;
+
+   for (i = 0; i < 32; i++)
+     s[i] = hex[(id[i >> 4] >> (60 - 4 * (i & 15))) & 0xf];
+   s[32] = 0;
+}
+
+static void
+_log_line_init(Log *log,
+               Smman *smman,
+               Filter *filter,
+               const char *line,
+               const Log_Field *fields,
+               unsigned int fields_count)
+{
+   memset(log, 0, sizeof(Log));
+   log->message = line;
+   log->filename = filter->filename;
+   log->source_host = smman->cfg.host;
+   log->source_path = filter->filename;
+   log->filter = filter;
+   log->fields = fields;
+   log->fields_count = fields_count;
+}
+
+static void
+_log_line_apply(Smman *smman,
+                Filter *filter,
+                Log *log)
+{
+   Rule *rule;
+   Eina_List *l,
+             *rules = NULL;
+   Syslog sh;
+   Rule_Event ev;
+   char program[64];
+
+   if (!timestamp_parse(&filter->ts, log->message, &log->timestamp))
+     log->timestamp = 0.0;
+
+   syslog_parse(log->message, &sh);
+
+   rules_event_init(&ev);
+   ev.line = log->message;
+   ev.message = sh.message;
+   ev.program = sh.program;
+   ev.program_len = sh.program_len;
+   ev.host = sh.host;
+   ev.host_len = sh.host_len;
+   ev.pid = sh.pid;
+   ev.filename = filter->filename;
+
+   /* Only rules for the program of the line and generic ones apply */
+   if ((eina_hash_population(filter->dispatch.programs)) &&
+       (sh.program_len) && (sh.program_len < sizeof(program)))
+     {
+        memcpy(program, sh.program, sh.program_len);
+        program[sh.program_len] = 0;
+        rules = eina_hash_find(filter->dispatch.programs, program);
+     }
 
-        if (rule->spec.source_path)
-          eina_stringshare_replace(&log->source_path, rule->spec.source_path);
+   EINA_LIST_FOREACH(filter->dispatch.generic, l, rule)
+     {
+        if (!_log_line_rule(log, &ev, rule))
+          return;
+     }
 
-        EINA_LIST_FOREACH(rule->spec.tags, l, tag)
-          log->tags = eina_list_append(log->tags, strdup(tag));
+   EINA_LIST_FOREACH(rules, l, rule)
+     {
+        if (!_log_line_rule(log, &ev, rule))
+          return;
      }
-   eina_iterator_free(it);
 
-   if (log->todel)
-     goto log_end;
+   /* Lines only matched by limited rules are the ones they drop */
+   if ((log->limited) && (!log->matched))
+     return;
 
    _log_send(smman, log);
+}
+
+void
+log_line_send(Smman *smman,
+              Filter *filter,
+              Spy_Line *sl,
+              const char *line,
+              const Log_Field *fields,
+              unsigned int fields_count)
+{
+   Log log;
+   uint64_t hid[2];
+   char id[33];
+
+   _log_line_init(&log, smman, filter, line, fields, fields_count);
+
+   if (sl)
+     {
+        spy_line_id_get(sl, hid);
+        _log_id_fill(id, hid);
+        log.id = id;
+        log.offset = spy_line_offset_get(sl);
+        log.line = spy_line_number_get(sl);
+     }
+
+   _log_line_apply(smman, filter, &log);
+}
+
+/*
+ * The first occurrence of the line already went through sample and
+ * rate_limit, so the report of its repeats is not limited again. Its id
+ * is the one of the first repeat, so that a replay gives the same one.
+ */
+void
+log_repeat_send(Smman *smman,
+                Filter *filter,
+                const uint64_t hid[2],
+                const char *line,
+                const Log_Field *fields,
+                unsigned int fields_count)
+{
+   Log log;
+   char id[33];
+
+   _log_line_init(&log, smman, filter, line, fields, fields_count);
+   _log_id_fill(id, hid);
+   log.id = id;
+   log.unlimited = EINA_TRUE;
+
+   _log_line_apply(smman, filter, &log);
+}
+
+Eina_Bool
+log_line_event(void *data,
+               int type EINA_UNUSED,
+               void *event)
+{
+   Smman *smman = data;
+   Spy_Line *sl = event;
+   Spy_File *sf = spy_line_spyfile_get(sl);
+   Filter *filter = spy_file_data_get(sf);
+
+   DBG("smman[%p] sl[%p][%s] filter[%p][%s]",
+       smman, sl, spy_file_name_get(sf), filter, filter->filename);
+
+   if ((filter->dedup.slots) && (dedup_line(smman, filter, sl)))
+     return EINA_TRUE;
 
-log_end:
-   _log_free(log);
+   log_line_send(smman, filter, sl, spy_line_get(sl), NULL, 0);
    return EINA_TRUE;
 }
@@ -17,6 +17,7 @@
  */
 
 #include "smman.h"
+#include <unistd.h>
 
 static const Ecore_Getopt optdesc = {
    "smman",
@@ -47,6 +48,7 @@ Smman *
 init(void)
 {
    Smman *smman;
+   char host[256];
 
    smman_log_dom_global = eina_log_domain_register("smman", EINA_COLOR_CYAN);
    if (smman_log_dom_global < 0)
@@ -76,14 +78,22 @@ init(void)
         return NULL;
      }
 
+   /* Same line of the same file on another host is another document */
+   if (gethostname(host, sizeof(host)))
+     host[0] = 0;
+   host[sizeof(host) - 1] = 0;
+   spy_seed_set(smman->spy, host);
+
    smman->ev.sl = ecore_event_handler_add(SPY_EVENT_LINE,log_line_event, smman);
    smman->ev.su = ecore_event_handler_add(ECORE_EVENT_SIGNAL_USER, filter_reload, smman);
+   smman->dedup = ecore_timer_loop_add(1.0, dedup_timer, smman);
    return smman;
 }
 
 int main(int argc, char **argv)
 {
    Smman *smman;
+   Filter *filter;
    Eina_Bool opt_quit = EINA_FALSE,
              opt_debug = EINA_FALSE;
    int opt_ind;
@@ -125,6 +135,16 @@ int main(int argc, char **argv)
 
    ecore_main_loop_begin();
 
+   /* Collapsed repeats and lingering batches are sent or spooled */
+   if (smman->store)
+     {
+        EINA_INLIST_FOREACH(smman->filters, filter)
+          dedup_flush(smman, filter, EINA_TRUE);
+        store_batch_flush(smman->store);
+        store_free(smman->store);
+        smman->store = NULL;
+     }
+
    store_shutdown();
    spy_shutdown();
    rules_shutdown();
@@ -0,0 +1,168 @@
+#include "smman.h"
+
+static void
+_route_index_free(void *data)
+{
+   Route_Index *ri = data;
+
+   free((char *)ri->pattern);
+   free(ri);
+}
+
+/* Returns the shared Route_Index of a pattern, NULL if pattern is invalid */
+Route_Index *
+route_index_get(Smman *smman,
+                const char *pattern)
+{
+   Route_Index *ri;
+   const char *p;
+
+   if (!smman->routes.indexes)
+     smman->routes.indexes = eina_hash_string_superfast_new(_route_index_free);
+
+   ri = eina_hash_find(smman->routes.indexes, pattern);
+   if (ri)
+     return ri;
+
+   /* Names go unescaped in _bulk action lines */
+   for (p = pattern; *p; p++)
+     {
+        if ((*p == '"') || (*p == '\\') || ((unsigned char)*p < 0x20))
+          break;
+     }
+   if ((!pattern[0]) || (*p) || (strlen(pattern) > ROUTE_INDEX_LEN))
+     {
+        ERR("Invalid index \"%s\"", pattern);
+        return NULL;
+     }
+
+   ri = calloc(1, sizeof(Route_Index));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ri, NULL);
+   ri->pattern = strdup(pattern);
+   ri->dated = !!strchr(pattern, '%');
+   ri->key = -1;
+   if (!ri->dated)
+     strcpy(ri->name, pattern);
+
+   eina_hash_add(smman->routes.indexes, pattern, ri);
+   return ri;
+}
+
+static int
+_route_tag_cmp(const void *d1,
+               const void *d2)
+{
+   const Route_Tag *rt1 = d1,
+                   *rt2 = d2;
+
+   return strcmp(rt1->tag, rt2->tag);
+}
+
+Eina_Bool
+route_tag_add(Smman *smman,
+              const char *tag,
+              const char *pattern)
+{
+   Route_Tag *rt;
+   Route_Index *ri;
+
+   ri = route_index_get(smman, pattern);
+   if (!ri)
+     return EINA_FALSE;
+
+   rt = calloc(1, sizeof(Route_Tag));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(rt, EINA_FALSE);
+   rt->tag = strdup(tag);
+   rt->index = ri;
+   smman->routes.tags = eina_list_sorted_insert(smman->routes.tags,
+                                                _route_tag_cmp, rt);
+   smman->routes.resolved = EINA_FALSE;
+   return EINA_TRUE;
+}
+
+/* Tag ids change with rules_purge() */
+void
+route_tags_reset(Smman *smman)
+{
+   smman->routes.resolved = EINA_FALSE;
+}
+
+static void
+_route_tags_resolve(Smman *smman)
+{
+   Route_Tag *rt;
+   Eina_List *l;
+
+   EINA_LIST_FOREACH(smman->routes.tags, l, rt)
+     {
+        rt->id = rules_tag_intern(smman->rules, rt->tag);
+        if (rt->id < 0)
+          WRN("Too many tags, can not route tag %s", rt->tag);
+     }
+   smman->routes.resolved = EINA_TRUE;
+}
+
+static const char *
+_route_index_name(Route_Index *ri,
+                  double t)
+{
+   time_t key;
+   struct tm tm;
+
+   if (!ri->dated)
+     return ri->name;
+
+   key = (time_t)((t > 0.0) ? t : ecore_time_unix_get());
+   if (key == ri->key)
+     return ri->name;
+
+   gmtime_r(&key, &tm);
+   if (!strftime(ri->name, sizeof(ri->name), ri->pattern, &tm))
+     {
+        ri->key = -1;
+        return NULL;
+     }
+   ri->key = key;
+   return ri->name;
+}
+
+/*
+ * Index of an event : index of its last matching rule having one, then
+ * the first route of its tags, by tag name, then the default one.
+ * NULL goes to the index of the server URL.
+ */
+const char *
+route_index(Smman *smman,
+            const char *pattern,
+            const Rule_Tags *tags,
+            double t)
+{
+   Route_Index *ri = NULL;
+   Route_Tag *rt;
+   Eina_List *l;
+
+   if (pattern)
+     ri = route_index_get(smman, pattern);
+
+   if ((!ri) && (smman->routes.tags))
+     {
+        if (!smman->routes.resolved)
+          _route_tags_resolve(smman);
+
+        EINA_LIST_FOREACH(smman->routes.tags, l, rt)
+          {
+             if ((rt->id >= 0) &&
+                 (tags->bits[rt->id >> 6] & ((uint64_t)1 << (rt->id & 63))))
+               {
+                  ri = rt->index;
+                  break;
+               }
+          }
+     }
+
+   if (!ri)
+     ri = smman->routes.def;
+   if (!ri)
+     return NULL;
+   return _route_index_name(ri, t);
+}
@@ -10,10 +10,32 @@
 #include <Rules.h>
 #include <Spy.h>
 #include <Store.h>
-#include <cJSON.h>
 
 int smman_log_dom_global;
 
+typedef struct _Log_Tag
+{
+   char *s; /* Tag as an escaped JSON string */
+   size_t len;
+} Log_Tag;
+
+#define ROUTE_INDEX_LEN 255 /* ElasticSearch limit */
+
+typedef struct _Route_Index
+{
+   const char *pattern; /* strftime() format, expanded with UTC time */
+   Eina_Bool dated; /* pattern has conversions */
+   time_t key; /* Second name was expanded for */
+   char name[ROUTE_INDEX_LEN + 1];
+} Route_Index;
+
+typedef struct _Route_Tag
+{
+   const char *tag;
+   int id; /* Tag id in rules, -1 once unknown */
+   Route_Index *index;
+} Route_Tag;
+
 typedef struct _Smman
 {
    Rules *rules;
@@ -25,8 +47,89 @@ typedef struct _Smman
    {
       const char *server,
                  *host;
+      double summary_interval;
+
+      struct
+      {
+         unsigned int max_docs;
+         size_t max_bytes;
+         double linger;
+      } bulk;
+      unsigned int max_inflight;
+
+      struct
+      {
+         unsigned int max_docs,
+                      max_inflight;
+         double linger;
+      } priority;
+      double adapt_latency; /* Target latency of requests, 0 for fixed limits */
+
+      struct
+      {
+         double max, /* Bytes per second to all servers, 0 for no limit */
+                endpoint_max; /* Bytes per second to each server */
+      } rate;
+
+      struct
+      {
+         unsigned int attempts;
+         double delay,
+                max_delay;
+      } retry;
+
+      struct
+      {
+         Store_Compress type;
+         int level;
+      } compress;
+
+      struct
+      {
+         const Store_Sink_Class *cls;
+         const char *path;
+         size_t max_bytes;
+         double max_age,
+                sync_interval;
+         Eina_Bool nodelay; /* Native client sets TCP_NODELAY */
+         double keepalive; /* Native client keeps idle connections */
+      } output;
+
+      struct
+      {
+         const char *dir;
+         size_t max_bytes;
+         Store_Spool_Policy policy;
+         double replay_rate;
+      } spool;
+
+      struct
+      {
+         size_t high_bytes,
+                low_bytes;
+         unsigned int high_batches,
+                      low_batches;
+      } watermarks;
    } cfg;
 
+   Ecore_Timer *summary, /* Suppressed lines report */
+               *dedup; /* Collapsed lines report */
+   Eina_Bool throttled; /* Store asked to stop reading */
+
+   struct
+   {
+      Log_Tag table[RULES_TAGS_MAX]; /* Indexed by rules tag id */
+      unsigned int count;
+   } tags;
+
+   struct
+   {
+      Eina_Hash *indexes; /* pattern -> Route_Index */
+      Eina_List *tags; /* Route_Tag, by tag name */
+      Route_Index *def; /* NULL to use the index of the server URL */
+      Eina_Bool resolved; /* Tag ids are known for current rules */
+   } routes;
+
    struct
    {
       Ecore_Event_Handler *sl, /* SPY_EVENT_LINE */
@@ -34,12 +137,105 @@ typedef struct _Smman
    } ev;
 } Smman;
 
+typedef struct _Dedup_Entry
+{
+   uint64_t hash,
+            id[2]; /* Id of the first repeat, which is never sent */
+   char *message;
+   unsigned long repeats;
+   double start, /* ecore_loop_time_get() of the first occurrence */
+          first, /* Unix time of the first repeat */
+          last; /* Unix time of the last repeat */
+} Dedup_Entry;
+
+#define DEDUP_SLOTS 1024
+
+typedef struct _Json_Buf
+{
+   char *s;
+   size_t len,
+          size;
+   Eina_Bool error;
+} Json_Buf;
+
+typedef struct _Log_Field
+{
+   const char *name,
+              *s; /* NULL for a numeric field */
+   double num;
+} Log_Field;
+
+#define LOG_TEMPLATE_RULES 8
+
+typedef struct _Log_Template
+{
+   EINA_INLIST;
+   const char *source_host, /* Borrowed, compared by pointer */
+              *source_path;
+   Rule *rules[LOG_TEMPLATE_RULES]; /* Matching rules having fields */
+   unsigned int rules_count;
+
+   char *prefix;
+   size_t prefix_len;
+   Eina_Bool fields; /* prefix has static fields */
+} Log_Template;
+
+typedef enum _Timestamp_Format
+{
+   TIMESTAMP_UNKNOWN,
+   TIMESTAMP_RFC3164, /* Oct 19 07:26:17 */
+   TIMESTAMP_ISO8601, /* 2026-10-19T07:26:17.123+02:00, also RFC5424 */
+   TIMESTAMP_APACHE, /* [19/Oct/2026:07:26:17 +0200] */
+   TIMESTAMP_NONE
+} Timestamp_Format;
+
+typedef struct _Timestamp_Detect
+{
+   Timestamp_Format format;
+   unsigned int misses;
+
+   struct
+   {
+      long key; /* Local date and hour of base */
+      time_t base;
+   } local;
+} Timestamp_Detect;
+
+#define TIMESTAMP_LEN 27
+
+typedef struct _Syslog
+{
+   const char *ts,
+              *host,
+              *program,
+              *message;
+   size_t ts_len,
+          host_len,
+          program_len;
+   long pid;
+} Syslog;
+
 typedef struct _Filter
 {
    EINA_INLIST;
    const char *filename;
    Spy_File *sf;
    Eina_Hash *rules;
+
+   struct
+   {
+      Eina_Hash *programs; /* program -> Eina_List of Rule */
+      Eina_List *generic; /* Rules without program */
+   } dispatch;
+
+   Eina_Inlist *templates;
+   Timestamp_Detect ts;
+
+   struct
+   {
+      double window;
+      Dedup_Entry *slots;
+   } dedup;
 } Filter;
 
 #define ERR(...) EINA_LOG_DOM_ERR(smman_log_dom_global, __VA_ARGS__)
@@ -55,8 +251,39 @@ void filter_load(void *data, Rules *rules, Rule *rule);
 void filter_load_done(void *data, Rules *rules);
 void filter_load_error(void *data, Rules *rules, const char *errstr);
 Eina_Bool filter_reload(void *data, int type, void *ev);
+void filter_throttle(void *data, Store *store, Eina_Bool throttled);
 
 Eina_Bool log_line_event(void *data, int type, void *event);
+void log_line_send(Smman *smman, Filter *filter, Spy_Line *sl, const char *line, const Log_Field *fields, unsigned int fields_count);
+void log_repeat_send(Smman *smman, Filter *filter, const uint64_t hid[2], const char *line, const Log_Field *fields, unsigned int fields_count);
+Eina_Bool log_summary(void *data);
+void log_tags_purge(Smman *smman);
+
+Eina_Bool dedup_line(Smman *smman, Filter *filter, Spy_Line *sl);
+void dedup_flush(Smman *smman, Filter *filter, Eina_Bool all);
+void dedup_setup(Filter *filter);
+Eina_Bool dedup_timer(void *data);
+
+Route_Index * route_index_get(Smman *smman, const char *pattern);
+Eina_Bool route_tag_add(Smman *smman, const char *tag, const char *pattern);
+void route_tags_reset(Smman *smman);
+const char * route_index(Smman *smman, const char *pattern, const Rule_Tags *tags, double t);
+
+Eina_Bool syslog_parse(const char *line, Syslog *sh);
+
+Eina_Bool json_reserve(Json_Buf *jb, size_t len);
+void json_reset(Json_Buf *jb);
+void json_append(Json_Buf *jb, const char *s, size_t len);
+void json_append_escaped(Json_Buf *jb, const char *s, size_t len);
+void json_append_string(Json_Buf *jb, const char *s);
+void json_append_number(Json_Buf *jb, double d);
+#define json_append_literal(jb, s) json_append(jb, s, sizeof(s) - 1)
+
+Log_Template * template_get(Smman *smman, Filter *filter, const char *source_host, const char *source_path, Rule **rules, unsigned int rules_count);
+void template_purge(Filter *filter);
+
+Eina_Bool timestamp_parse(Timestamp_Detect *td, const char *line, double *t);
+size_t timestamp_fill(char *s, double t);
+size_t timestamp_now(char *s);
 
 char * sdupf(const char *s, ...);
-char * date_es(void);
@@ -0,0 +1,104 @@
+#include "smman.h"
+#include <ctype.h>
+
+static const char *
+_syslog_token(const char *s,
+              size_t *len)
+{
+   const char *p;
+
+   for (p = s; (*p) && (*p != ' '); p++);
+   *len = p - s;
+   return (*p) ? p + 1 : p;
+}
+
+/*
+ * Splits the header of a syslog line, either in the traditional format :
+ *    Oct 19 07:26:17 host program[pid]: message
+ *    2026-10-19T07:26:17.123456+02:00 host program[pid]: message
+ * or in the RFC5424 format :
+ *    <34>1 2026-10-19T07:26:17.123Z host program pid msgid [sd] message
+ * Nothing is copied, sh only points inside of line.
+ */
+Eina_Bool
+syslog_parse(const char *line,
+             Syslog *sh)
+{
+   const char *p = line,
+              *s;
+   size_t len;
+
+   if (*p == '<')
+     {
+        for (p++; isdigit((unsigned char)*p); p++);
+        if (*p != '>')
+          goto error;
+        p++;
+
+        if ((isdigit((unsigned char)p[0])) && (p[1] == ' '))
+          {
+             p += 2;
+             sh->ts = p;
+             p = _syslog_token(p, &sh->ts_len);
+             sh->host = p;
+             p = _syslog_token(p, &sh->host_len);
+             sh->program = p;
+             p = _syslog_token(p, &sh->program_len);
+             s = p;
+             p = _syslog_token(p, &len);
+             sh->pid = atol(s);
+             p = _syslog_token(p, &len);
+             if (*p == '[')
+               {
+                  p = strstr(p, "] ");
+                  p = (p) ? p + 2 : line + strlen(line);
+               }
+             else if (*p == '-')
+               p = _syslog_token(p, &len);
+             sh->message = p;
+             return EINA_TRUE;
+          }
+     }
+
+   sh->ts = p;
+   if ((isalpha((unsigned char)p[0])) && (strlen(p) > 16) &&
+       (p[3] == ' ') && (p[15] == ' '))
+     {
+        sh->ts_len = 15;
+        p += 16;
+     }
+   else if (isdigit((unsigned char)p[0]))
+     p = _syslog_token(p, &sh->ts_len);
+   else
+     goto error;
+
+   sh->host = p;
+   p = _syslog_token(p, &sh->host_len);
+   if (!*p)
+     goto error;
+
+   sh->program = p;
+   for (; (*p) && (*p != '[') && (*p != ':') && (*p != ' '); p++);
+   sh->program_len = p - sh->program;
+
+   sh->pid = 0;
+   if (*p == '[')
+     {
+        sh->pid = atol(p + 1);
+        p = strchr(p, ']');
+        if (!p)
+          goto error;
+        p++;
+     }
+
+   if (*p != ':')
+     goto error;
+
+   sh->message = (p[1] == ' ') ? p + 2 : p + 1;
+   return EINA_TRUE;
+
+error:
+   memset(sh, 0, sizeof(Syslog));
+   sh->message = line;
+   return EINA_FALSE;
+}
@@ -0,0 +1,134 @@
+#include "smman.h"
+
+static void
+_template_free(Log_Template *tpl)
+{
+   free(tpl->prefix);
+   free(tpl);
+}
+
+static Eina_Bool
+_template_match(Log_Template *tpl,
+                const char *source_host,
+                const char *source_path,
+                Rule **rules,
+                unsigned int rules_count)
+{
+   if ((tpl->source_host != source_host) ||
+       (tpl->source_path != source_path) ||
+       (tpl->rules_count != rules_count))
+     return EINA_FALSE;
+
+   return !memcmp(tpl->rules, rules, rules_count * sizeof(Rule *));
+}
+
+/*
+ * Pre-serializes everything that does not change from one line to
+ * another for this filter and overrides :
+ * {"@source":"...","@type":"syslog","@source_host":"...",
+ *  "@source_path":"...","@fields":{<static fields>
+ */
+static Log_Template *
+_template_new(Smman *smman,
+              const char *source_host,
+              const char *source_path,
+              Rule **rules,
+              unsigned int rules_count)
+{
+   Log_Template *tpl;
+   Rule_Static_Field *rsf;
+   Json_Buf jb;
+   Eina_List *l;
+   unsigned int i;
+
+   tpl = calloc(1, sizeof(Log_Template));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(tpl, NULL);
+
+   tpl->source_host = source_host;
+   tpl->source_path = source_path;
+   tpl->rules_count = rules_count;
+   memcpy(tpl->rules, rules, rules_count * sizeof(Rule *));
+
+   memset(&jb, 0, sizeof(Json_Buf));
+   json_append_literal(&jb, "{\"@source\":\"file://");
+   if (smman->cfg.server)
+     json_append_escaped(&jb, smman->cfg.server, strlen(smman->cfg.server));
+   if (source_path)
+     json_append_escaped(&jb, source_path, strlen(source_path));
+   json_append_literal(&jb, "\",\"@type\":\"syslog\",\"@source_host\":");
+   json_append_string(&jb, source_host);
+   json_append_literal(&jb, ",\"@source_path\":");
+   json_append_string(&jb, source_path);
+   json_append_literal(&jb, ",\"@fields\":{");
+
+   for (i = 0; i < rules_count; i++)
+     {
+        EINA_LIST_FOREACH(rules[i]->spec.fields, l, rsf)
+          {
+             if (tpl->fields)
+               json_append_literal(&jb, ",");
+             json_append_string(&jb, rsf->name);
+             json_append_literal(&jb, ":");
+             json_append_string(&jb, rsf->value);
+             tpl->fields = EINA_TRUE;
+          }
+     }
+
+   if (jb.error)
+     {
+        free(jb.s);
+        _template_free(tpl);
+        return NULL;
+     }
+
+   tpl->prefix = jb.s;
+   tpl->prefix_len = jb.len;
+   return tpl;
+}
+
+Log_Template *
+template_get(Smman *smman,
+             Filter *filter,
+             const char *source_host,
+             const char *source_path,
+             Rule **rules,
+             unsigned int rules_count)
+{
+   Log_Template *tpl;
+
+   EINA_INLIST_FOREACH(filter->templates, tpl)
+     {
+        if (!_template_match(tpl, source_host, source_path,
+                             rules, rules_count))
+          continue;
+
+        if (EINA_INLIST_GET(tpl) != filter->templates)
+          filter->templates = eina_inlist_promote(filter->templates,
+                                                  EINA_INLIST_GET(tpl));
+        return tpl;
+     }
+
+   tpl = _template_new(smman, source_host, source_path, rules, rules_count);
+   if (!tpl)
+     return NULL;
+
+   DBG("filter[%p][%s] New template : %s", filter, filter->filename,
+       tpl->prefix);
+   filter->templates = eina_inlist_prepend(filter->templates,
+                                           EINA_INLIST_GET(tpl));
+   return tpl;
+}
+
+void
+template_purge(Filter *filter)
+{
+   Log_Template *tpl;
+
+   while (filter->templates)
+     {
+        tpl = EINA_INLIST_CONTAINER_GET(filter->templates, Log_Template);
+        filter->templates = eina_inlist_remove(filter->templates,
+                                               filter->templates);
+        _template_free(tpl);
+     }
+}
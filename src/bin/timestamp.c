@@ -0,0 +1,398 @@
+#include "smman.h"
+#include <ctype.h>
+
+#define TIMESTAMP_MISSES_MAX 16
+#define TIMESTAMP_RETRY 256
+
+static const char *_timestamp_months[] = {
+   "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static struct
+{
+   time_t sec;
+   char prefix[21]; /* YYYY-MM-DDTHH:MM:SS. */
+} _timestamp_cache = { (time_t)-1, "" };
+
+static struct
+{
+   double until; /* ecore_loop_time_get() of the next refresh */
+   int year,
+       mon; /* 0 to 11 */
+} _timestamp_today = { -1.0, 0, 0 };
+
+/* Days since 1970-01-01 of a proleptic gregorian date */
+static long
+_timestamp_days(long y,
+                unsigned int m,
+                unsigned int d)
+{
+   long era;
+   unsigned int yoe,
+                doy,
+                doe;
+
+   y -= (m <= 2);
+   era = ((y >= 0) ? y : y - 399) / 400;
+   yoe = (unsigned int)(y - era * 400);
+   doy = (153 * (m + ((m > 2) ? -3 : 9)) + 2) / 5 + d - 1;
+   doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+   return era * 146097 + (long)doe - 719468;
+}
+
+static int
+_timestamp_number(const char **p,
+                  unsigned int digits)
+{
+   int n = 0;
+
+   while (digits--)
+     {
+        if (!isdigit((unsigned char)**p))
+          return -1;
+        n = n * 10 + (**p - '0');
+        (*p)++;
+     }
+   return n;
+}
+
+static int
+_timestamp_month(const char *p)
+{
+   int i;
+
+   for (i = 0; i < 12; i++)
+     if (!strncmp(p, _timestamp_months[i], 3))
+       return i + 1;
+   return -1;
+}
+
+/*
+ * Converts a local time to a unix time. mktime() is only called once
+ * per hour of logs, as the result is cached in the detector.
+ */
+static double
+_timestamp_local(Timestamp_Detect *td,
+                 int year, int mon, int mday,
+                 int hour, int min, int sec)
+{
+   struct tm tm;
+   long key;
+
+   key = (((long)year * 12 + mon) * 31 + mday) * 24 + hour;
+   if (key != td->local.key)
+     {
+        memset(&tm, 0, sizeof(struct tm));
+        tm.tm_year = year - 1900;
+        tm.tm_mon = mon - 1;
+        tm.tm_mday = mday;
+        tm.tm_hour = hour;
+        tm.tm_isdst = -1;
+        td->local.base = mktime(&tm);
+        td->local.key = key;
+     }
+   return (double)td->local.base + min * 60 + sec;
+}
+
+static Eina_Bool
+_timestamp_hms(const char **p,
+               int *hour,
+               int *min,
+               int *sec)
+{
+   *hour = _timestamp_number(p, 2);
+   if ((*hour < 0) || (*(*p)++ != ':')) return EINA_FALSE;
+   *min = _timestamp_number(p, 2);
+   if ((*min < 0) || (*(*p)++ != ':')) return EINA_FALSE;
+   *sec = _timestamp_number(p, 2);
+   return (*sec >= 0);
+}
+
+/* Parses a +hh:mm, +hhmm or Z timezone, returns the offset in seconds */
+static Eina_Bool
+_timestamp_zone(const char **p,
+                long *offset)
+{
+   int sign,
+       h,
+       m;
+
+   if (**p == 'Z')
+     {
+        (*p)++;
+        *offset = 0;
+        return EINA_TRUE;
+     }
+
+   if ((**p != '+') && (**p != '-'))
+     return EINA_FALSE;
+
+   sign = (**p == '-') ? -1 : 1;
+   (*p)++;
+   h = _timestamp_number(p, 2);
+   if (**p == ':') (*p)++;
+   m = _timestamp_number(p, 2);
+   if ((h < 0) || (m < 0))
+     return EINA_FALSE;
+
+   *offset = sign * (h * 3600 + m * 60);
+   return EINA_TRUE;
+}
+
+/*
+ * Local year and month of now, for lines without a year. localtime_r()
+ * is only called once per second of loop time.
+ */
+static void
+_timestamp_today_update(void)
+{
+   struct tm now;
+   time_t clock;
+   double loop = ecore_loop_time_get();
+
+   if (loop < _timestamp_today.until)
+     return;
+
+   clock = time(NULL);
+   localtime_r(&clock, &now);
+   _timestamp_today.year = now.tm_year + 1900;
+   _timestamp_today.mon = now.tm_mon;
+   _timestamp_today.until = loop + 1.0;
+}
+
+/* Oct 19 07:26:17, with no year and in local time */
+static Eina_Bool
+_timestamp_rfc3164(Timestamp_Detect *td,
+                   const char *p,
+                   double *t)
+{
+   int mon,
+       mday,
+       hour,
+       min,
+       sec,
+       year;
+
+   mon = _timestamp_month(p);
+   if ((mon < 0) || (p[3] != ' '))
+     return EINA_FALSE;
+   p += 4;
+
+   if (*p == ' ') p++;
+   mday = (isdigit((unsigned char)p[1])) ? _timestamp_number(&p, 2) :
+                            _timestamp_number(&p, 1);
+   if ((mday < 1) || (*p++ != ' '))
+     return EINA_FALSE;
+
+   if (!_timestamp_hms(&p, &hour, &min, &sec))
+     return EINA_FALSE;
+
+   _timestamp_today_update();
+   year = _timestamp_today.year;
+
+   /* A december line read in january is from last year */
+   if (mon > _timestamp_today.mon + 2)
+     year--;
+
+   *t = _timestamp_local(td, year, mon, mday, hour, min, sec);
+   return EINA_TRUE;
+}
+
+/* 2026-10-19T07:26:17.123456+02:00, zone and fraction are optional */
+static Eina_Bool
+_timestamp_iso8601(Timestamp_Detect *td,
+                   const char *p,
+                   double *t)
+{
+   int year,
+       mon,
+       mday,
+       hour,
+       min,
+       sec;
+   double frac = 0.0,
+          scale = 0.1;
+   long offset;
+
+   year = _timestamp_number(&p, 4);
+   if ((year < 0) || (*p++ != '-')) return EINA_FALSE;
+   mon = _timestamp_number(&p, 2);
+   if ((mon < 1) || (mon > 12) || (*p++ != '-')) return EINA_FALSE;
+   mday = _timestamp_number(&p, 2);
+   if ((mday < 1) || ((*p != 'T') && (*p != ' '))) return EINA_FALSE;
+   p++;
+
+   if (!_timestamp_hms(&p, &hour, &min, &sec))
+     return EINA_FALSE;
+
+   if ((*p == '.') || (*p == ','))
+     for (p++; isdigit((unsigned char)*p); p++, scale /= 10.0)
+       frac += (*p - '0') * scale;
+
+   if (!_timestamp_zone(&p, &offset))
+     {
+        *t = _timestamp_local(td, year, mon, mday, hour, min, sec) + frac;
+        return EINA_TRUE;
+     }
+
+   *t = (double)(_timestamp_days(year, mon, mday) * 86400 +
+                 hour * 3600 + min * 60 + sec - offset) + frac;
+   return EINA_TRUE;
+}
+
+/* [19/Oct/2026:07:26:17 +0200] anywhere in the line */
+static Eina_Bool
+_timestamp_apache(Timestamp_Detect *td EINA_UNUSED,
+                  const char *line,
+                  double *t)
+{
+   const char *p;
+   int year,
+       mon,
+       mday,
+       hour,
+       min,
+       sec;
+   long offset;
+
+   for (p = strchr(line, '['); p; p = strchr(p + 1, '['))
+     {
+        const char *s = p + 1;
+
+        mday = _timestamp_number(&s, 2);
+        if ((mday < 1) || (*s++ != '/')) continue;
+        mon = _timestamp_month(s);
+        if ((mon < 0) || (s[3] != '/')) continue;
+        s += 4;
+        year = _timestamp_number(&s, 4);
+        if ((year < 0) || (*s++ != ':')) continue;
+        if (!_timestamp_hms(&s, &hour, &min, &sec)) continue;
+        if ((*s++ != ' ') || (!_timestamp_zone(&s, &offset))) continue;
+
+        *t = (double)(_timestamp_days(year, mon, mday) * 86400 +
+                      hour * 3600 + min * 60 + sec - offset);
+        return EINA_TRUE;
+     }
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_timestamp_try(Timestamp_Detect *td,
+               Timestamp_Format format,
+               const char *line,
+               double *t)
+{
+   const char *p = line;
+
+   switch (format)
+     {
+      case TIMESTAMP_RFC3164:
+      case TIMESTAMP_ISO8601:
+        /* Skip the <PRI> and version of RFC5424 lines */
+        if (*p == '<')
+          {
+             p = strchr(p, '>');
+             if (!p) return EINA_FALSE;
+             p++;
+             if ((isdigit((unsigned char)p[0])) && (p[1] == ' ')) p += 2;
+          }
+        return (format == TIMESTAMP_RFC3164) ?
+               _timestamp_rfc3164(td, p, t) : _timestamp_iso8601(td, p, t);
+      case TIMESTAMP_APACHE:
+        return _timestamp_apache(td, line, t);
+      default:
+        return EINA_FALSE;
+     }
+}
+
+/*
+ * Finds when the event of line happened.
+ * The format that matched last time for this file is tried first, if no
+ * format matches several lines in a row, the file is considered as
+ * having no timestamp and detection is only retried from time to time.
+ */
+Eina_Bool
+timestamp_parse(Timestamp_Detect *td,
+                const char *line,
+                double *t)
+{
+   Timestamp_Format format;
+
+   if (td->format == TIMESTAMP_NONE)
+     {
+        if (++td->misses % TIMESTAMP_RETRY)
+          return EINA_FALSE;
+     }
+   else if ((td->format != TIMESTAMP_UNKNOWN) &&
+            (_timestamp_try(td, td->format, line, t)))
+     {
+        td->misses = 0;
+        return EINA_TRUE;
+     }
+
+   for (format = TIMESTAMP_RFC3164; format <= TIMESTAMP_APACHE; format++)
+     {
+        if ((format == td->format) || (!_timestamp_try(td, format, line, t)))
+          continue;
+
+        DBG("Detected timestamp format %i for line \"%s\"", format, line);
+        td->format = format;
+        td->misses = 0;
+        return EINA_TRUE;
+     }
+
+   if ((td->format != TIMESTAMP_NONE) &&
+       (++td->misses >= TIMESTAMP_MISSES_MAX))
+     {
+        DBG("No timestamp format found, giving up for now");
+        td->format = TIMESTAMP_NONE;
+        td->misses = 0;
+     }
+   return EINA_FALSE;
+}
+
+/*
+ * Writes t as 2026-10-19T07:26:17.123456Z (UTC) to s, that must hold
+ * TIMESTAMP_LEN + 1 bytes. The part up to the seconds is only
+ * formatted once per second.
+ */
+size_t
+timestamp_fill(char *s,
+               double t)
+{
+   struct tm tm;
+   time_t sec;
+   int usec,
+       i;
+
+   sec = (time_t)t;
+   usec = (int)((t - (double)sec) * 1000000.0);
+   if (usec > 999999) usec = 999999;
+   if (usec < 0) usec = 0;
+
+   if (sec != _timestamp_cache.sec)
+     {
+        if (!gmtime_r(&sec, &tm))
+          return 0;
+
+        snprintf(_timestamp_cache.prefix, sizeof(_timestamp_cache.prefix),
+                 "%04d-%02d-%02dT%02d:%02d:%02d.",
+                 tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                 tm.tm_hour, tm.tm_min, tm.tm_sec);
+        _timestamp_cache.sec = sec;
+     }
+
+   memcpy(s, _timestamp_cache.prefix, 20);
+   for (i = 25; i >= 20; i--, usec /= 10)
+     s[i] = '0' + usec % 10;
+   s[26] = 'Z';
+   s[27] = 0;
+   return TIMESTAMP_LEN;
+}
+
+size_t
+timestamp_now(char *s)
+{
+   return timestamp_fill(s, ecore_time_unix_get());
+}
@@ -6,6 +6,7 @@
 #include <Conf.h>
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <regex.h>
 
 /**
@@ -15,6 +16,56 @@
 
 typedef struct _Rules Rules;
 typedef struct _Rule Rule;
+typedef struct _Rule_Condition Rule_Condition;
+
+#define RULES_TAGS_MAX 256 /*!< Max number of distinct tags */
+
+/**
+ * @brief Set of tags, as a bitset of tag ids.
+ *
+ * Tag ids are given by rules_tag_intern() and stay valid until
+ * rules_purge().
+ */
+typedef struct _Rule_Tags
+{
+   uint64_t bits[RULES_TAGS_MAX / 64];
+} Rule_Tags;
+
+#define RULE_TAGS_SET(t, id) \
+   ((t)->bits[(id) >> 6] |= (uint64_t)1 << ((id) & 63))
+#define RULE_TAGS_MERGE(dst, src)                                    \
+   do {                                                              \
+      unsigned int _i;                                               \
+      for (_i = 0; _i < RULES_TAGS_MAX / 64; _i++)                   \
+        (dst)->bits[_i] |= (src)->bits[_i];                          \
+   } while (0)
+
+/**
+ * @brief Fields of a line, used to evaluate conditions.
+ *
+ * Strings are not copied, program and host may not be NUL terminated.
+ */
+typedef struct _Rule_Event
+{
+   const char *line, /*!< Full line */
+              *message, /*!< Line without its syslog header */
+              *program,
+              *host,
+              *filename;
+   size_t program_len,
+          host_len;
+   long pid;
+
+   unsigned long gen; /*!< Set by rules_event_init() */
+
+   struct
+   {
+      const char *s;
+      size_t len;
+      uint32_t addr;
+      Eina_Bool done;
+   } ip; /*!< First IPv4 of the message, found on demand */
+} Rule_Event;
 
 struct _Rule
 {
@@ -25,13 +76,36 @@ struct _Rule
    {
       const char *filename,
                  *source_host,
-                 *source_path;
+                 *source_path,
+                 *program; /*!< Only match lines of this syslog program */
       Eina_List *tags;
+      Rule_Tags tagset; /*!< Interned ids of tags */
       Eina_Bool todel;
       Eina_Inlist *regex;
+      Rule_Condition *condition; /*!< Compiled condition key */
+      Eina_List *fields; /*!< Rule_Static_Field from field.<name> keys */
+      unsigned int sample; /*!< Keep 1 matching line out of sample */
+      double rate_limit; /*!< Max matching lines per second */
+      double dedup; /*!< Window (seconds) for collapsing repeated lines */
+      const char *index; /*!< Index pattern of matching lines, NULL for default */
+      Eina_Bool priority; /*!< Matching lines skip ahead of other lines */
    } spec;
+
+   struct
+   {
+      unsigned long seen, /*!< Lines matched since load */
+                    suppressed; /*!< Lines dropped since last summary */
+      double tokens, /*!< Token bucket content for rate_limit */
+             last; /*!< Last time the bucket was refilled */
+   } limit;
 };
 
+typedef struct _Rule_Static_Field
+{
+   const char *name,
+              *value;
+} Rule_Static_Field;
+
 typedef struct _Rule_Regex
 {
    EINA_INLIST;
@@ -54,6 +128,15 @@ Eina_Bool rules_load(Rules *rules, Rules_Progress_Cb progress_cb, Rules_Done_Cb
 
 void rules_rule_free(Rule *rule);
 
+int rules_tag_intern(Rules *rules, const char *tag);
+const char * rules_tag_name_get(Rules *rules, unsigned int id);
+unsigned int rules_tags_count(Rules *rules);
+
+Rule_Condition * rules_condition_new(Rules *rules, const char *expr);
+void rules_condition_free(Rule_Condition *rc);
+Eina_Bool rules_condition_eval(Rule_Condition *rc, Rule_Event *ev);
+void rules_event_init(Rule_Event *ev);
+
 /**
  * @}
  */
@@ -3,6 +3,8 @@
 #include <Eina.h>
 #include <Ecore.h>
 #include <Eio.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 /**
  * @addtogroup Lib-Spy-Functions
@@ -20,6 +22,7 @@ int spy_shutdown(void);
 
 Spy * spy_new(void);
 void spy_free(Spy *spy);
+void spy_seed_set(Spy *spy, const char *seed);
 
 void spy_file_free(Spy_File *sf);
 Spy_File * spy_file_new(Spy *spy, const char *file);
@@ -32,6 +35,10 @@ void spy_file_resume(Spy_File *sf);
 
 const char * spy_line_get(Spy_Line *sl);
 Spy_File * spy_line_spyfile_get(Spy_Line *sl);
+uint64_t spy_line_hash_get(Spy_Line *sl);
+void spy_line_id_get(Spy_Line *sl, uint64_t id[2]);
+off_t spy_line_offset_get(Spy_Line *sl);
+unsigned long spy_line_number_get(Spy_Line *sl);
 
 /**
  * @}
@@ -7,15 +7,135 @@
 
 typedef struct _Store Store;
 
+/**
+ * @brief Documents sent together to a sink, see Store_Sink_Class.
+ */
+typedef struct _Store_Batch Store_Request;
+
+/**
+ * @brief What to do with a batch when the spool is full.
+ */
+typedef enum _Store_Spool_Policy
+{
+   STORE_SPOOL_DROP_OLDEST, /*!< Drop oldest segments to make room */
+   STORE_SPOOL_BACKPRESSURE /*!< Keep batch in memory, waiting to be sent */
+} Store_Spool_Policy;
+
+/**
+ * @brief Encoding of request bodies.
+ */
+typedef enum _Store_Compress
+{
+   STORE_COMPRESS_NONE, /*!< Send bodies as is */
+   STORE_COMPRESS_GZIP /*!< Content-Encoding: gzip */
+} Store_Compress;
+
+/**
+ * @brief Counters of a Store, given by store_stats_get().
+ */
+typedef struct _Store_Stats
+{
+   unsigned int inflight, /*!< Requests being sent */
+                priority_inflight, /*!< Priority requests being sent */
+                priority_pending, /*!< Priority batches waiting */
+                pending, /*!< Batches waiting in memory */
+                endpoints, /*!< Servers documents are sent to */
+                endpoints_down; /*!< Servers ejected for failing */
+   size_t bytes, /*!< Bytes of documents held in memory */
+          spool_bytes; /*!< Bytes in the spool */
+   unsigned long spool_dropped; /*!< Bytes dropped from a full spool */
+
+   Eina_Bool throttled; /*!< Readers are asked to stop */
+   unsigned long throttled_count; /*!< Times readers were asked to stop */
+   double throttled_time; /*!< Seconds spent throttled */
+
+   Eina_Bool adaptive; /*!< Batching adapts to latency */
+   unsigned int batch_docs, /*!< Max documents of a batch in use */
+                max_inflight; /*!< Max requests in flight in use */
+   size_t batch_bytes; /*!< Max size of a batch body in use */
+   double batch_linger, /*!< Linger of batches in use */
+          latency, /*!< Average latency of requests */
+          doc_cost; /*!< Average latency per document */
+   unsigned long adapt_increases, /*!< Times limits grew */
+                 adapt_decreases; /*!< Times limits were cut */
+
+   double rate_limit, /*!< Max bytes per second sent, 0 for no limit */
+          endpoint_rate_limit, /*!< Max bytes per second to each endpoint */
+          rate; /*!< Bytes per second sent lately */
+   unsigned long long bytes_sent; /*!< Bytes sent, compressed if they are */
+   unsigned long paced; /*!< Times a request waited for its bytes */
+} Store_Stats;
+
+/**
+ * @brief Whether a sink can take a request, given by its state function.
+ */
+typedef enum _Store_Sink_State
+{
+   STORE_SINK_READY, /*!< Request can be sent now */
+   STORE_SINK_BUSY, /*!< Sink will tell when it can, by ending a request */
+   STORE_SINK_DOWN, /*!< Sink can not take requests before a given time */
+   STORE_SINK_PACED /*!< Sink can take requests at a given time, they wait in memory meanwhile */
+} Store_Sink_State;
+
+/**
+ * @brief Functions of a destination documents are written to.
+ *
+ * Store keeps batching, queuing, retries, spool and throttling, and
+ * gives each batch to the send function of its sink. The sink ends
+ * every request it accepted with store_request_done().
+ */
+typedef struct _Store_Sink_Class
+{
+   const char *name;
+   void * (*open)(Store *store, const char *target); /*!< NULL on failure */
+   void (*close)(void *sink); /*!< Ends requests being sent with status 0 */
+   Store_Sink_State (*state)(void *sink, Store_Request *req, double *when); /*!< @p req is NULL when asked for any request, @p when is set for STORE_SINK_DOWN and STORE_SINK_PACED */
+   Eina_Bool (*send)(void *sink, Store_Request *req); /*!< EINA_FALSE if request was not taken */
+} Store_Sink_Class;
+
+extern const Store_Sink_Class store_sink_http; /*!< ElasticSearch servers, target is an URL */
+extern const Store_Sink_Class store_sink_file; /*!< NDJSON file, target is a path */
+extern const Store_Sink_Class store_sink_stdout; /*!< NDJSON lines on stdout, target is ignored */
+extern const Store_Sink_Class store_sink_native; /*!< ElasticSearch server, with the built-in HTTP/1.1 client, target is an http URL */
+
 typedef void (*Store_Done_Cb)(void *data, Store *store, char *answer, size_t len);
 typedef void (*Store_Error_Cb)(void *data, Store *store, char *strerr);
+typedef void (*Store_Throttle_Cb)(void *data, Store *store, Eina_Bool throttled);
 
 int store_init(void);
 int store_shutdown(void);
 
 Store * store_new(const char *url);
+Store * store_sink_new(const Store_Sink_Class *cls, const char *target);
+void store_free(Store *store);
+Eina_Bool store_endpoint_add(Store *store, const char *url);
 Eina_Bool store_add(Store *store, const char *buf, size_t len, Store_Done_Cb done_cb, Store_Error_Cb error_cb, const void *data);
 
+void store_batch_set(Store *store, unsigned int max_docs, size_t max_bytes, double linger);
+Eina_Bool store_batch_add(Store *store, const char *buf, size_t len, Store_Done_Cb done_cb, Store_Error_Cb error_cb, const void *data);
+Eina_Bool store_batch_index_add(Store *store, const char *index, const char *id, const char *buf, size_t len, Store_Done_Cb done_cb, Store_Error_Cb error_cb, const void *data);
+Eina_Bool store_batch_priority_add(Store *store, const char *index, const char *id, const char *buf, size_t len, Store_Done_Cb done_cb, Store_Error_Cb error_cb, const void *data);
+void store_batch_flush(Store *store);
+
+void store_inflight_set(Store *store, unsigned int max_inflight);
+void store_priority_set(Store *store, unsigned int max_docs, double linger, unsigned int max_inflight);
+void store_retry_set(Store *store, unsigned int attempts, double delay, double max_delay);
+void store_compress_set(Store *store, Store_Compress type, int level);
+void store_adapt_set(Store *store, double target);
+void store_rate_set(Store *store, double limit, double endpoint_limit);
+void store_file_set(Store *store, size_t max_bytes, double max_age, double sync_interval);
+void store_native_set(Store *store, Eina_Bool nodelay, double keepalive);
+Eina_Bool store_spool_set(Store *store, const char *dir, size_t max_bytes, Store_Spool_Policy policy, double replay_rate);
+
+void store_watermarks_set(Store *store, size_t high_bytes, size_t low_bytes, unsigned int high_batches, unsigned int low_batches);
+void store_throttle_callback_set(Store *store, Store_Throttle_Cb throttle_cb, const void *data);
+void store_stats_get(Store *store, Store_Stats *stats);
+
+const char * store_request_body_get(Store_Request *req, size_t *len);
+unsigned int store_request_count_get(Store_Request *req);
+Eina_Bool store_request_bulk_get(Store_Request *req);
+void store_request_done(Store *store, Store_Request *req, int status, char *answer, size_t len);
+
 void store_data_set(Store *store, const void *data);
 void * store_data_get(Store *store);
 #endif
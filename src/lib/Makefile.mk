@@ -27,6 +27,7 @@ src_lib_libspy_la_LDFLAGS = $(LIBS_LIBS)
 src_lib_librules_la_SOURCES = \
 src/lib/rules/rules_main.c \
 src/lib/rules/rules_load.c \
+src/lib/rules/rules_condition.c \
 src/lib/rules/rules_private.h \
 src/include/Rules.h
 src_lib_librules_la_CFLAGS = $(LIBS_CFLAGS) $(EXTRA_CPPFLAGS)
@@ -39,6 +40,15 @@ src/lib/libconf.la
 src_lib_libstore_la_SOURCES = \
 src/lib/store/store_main.c \
 src/lib/store/store_event.c \
+src/lib/store/store_batch.c \
+src/lib/store/store_pool.c \
+src/lib/store/store_adapt.c \
+src/lib/store/store_rate.c \
+src/lib/store/store_http.c \
+src/lib/store/store_file.c \
+src/lib/store/store_native.c \
+src/lib/store/store_spool.c \
+src/lib/store/store_gz.c \
 src/lib/store/store_utils.c \
 src/lib/store/store_private.h \
 src/include/Store.h
@@ -0,0 +1,990 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#include "rules_private.h"
+
+#include <ctype.h>
+
+/**
+ * @addtogroup Lib-Rules-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+static unsigned long _rules_event_gen = 0;
+
+static const struct
+{
+   const char *name;
+   Rule_Field field;
+   unsigned int cost; /*!< Cost of reading the field */
+} _rules_fields[] = {
+   { "pid", RULE_FIELD_PID, 0 },
+   { "program", RULE_FIELD_PROGRAM, 1 },
+   { "host", RULE_FIELD_HOST, 1 },
+   { "file", RULE_FIELD_FILENAME, 1 },
+   { "message", RULE_FIELD_MESSAGE, 2 },
+   { "line", RULE_FIELD_LINE, 2 },
+   { "ip", RULE_FIELD_IP, 4 },
+   { NULL, 0, 0 }
+};
+
+typedef enum _Rule_Token_Type
+{
+   RULE_TOKEN_END,
+   RULE_TOKEN_WORD,
+   RULE_TOKEN_STRING,
+   RULE_TOKEN_LPAREN,
+   RULE_TOKEN_RPAREN,
+   RULE_TOKEN_AND,
+   RULE_TOKEN_OR,
+   RULE_TOKEN_NOT,
+   RULE_TOKEN_OP
+} Rule_Token_Type;
+
+typedef enum _Rule_Node_Type
+{
+   RULE_NODE_PRED,
+   RULE_NODE_NOT,
+   RULE_NODE_AND,
+   RULE_NODE_OR
+} Rule_Node_Type;
+
+typedef struct _Rule_Node
+{
+   Rule_Node_Type type;
+   Eina_List *children;
+   Rule_Predicate *pred;
+   unsigned int cost;
+} Rule_Node;
+
+typedef struct _Rule_Parser
+{
+   Rules *rules;
+   const char *p;
+
+   struct
+   {
+      Rule_Token_Type type;
+      Rule_Op op;
+      Eina_Strbuf *buf;
+   } token;
+
+   const char *error;
+} Rule_Parser;
+
+static Rule_Node * _rules_condition_parse_or(Rule_Parser *rp);
+
+static void
+_rules_node_free(Rule_Node *node)
+{
+   Rule_Node *child;
+
+   if (!node)
+     return;
+
+   EINA_LIST_FREE(node->children, child)
+     _rules_node_free(child);
+   free(node);
+}
+
+/**
+ * @brief Reads the next token of a condition.
+ * @param rp Rule_Parser structure.
+ * @return EINA_FALSE on syntax error.
+ */
+static Eina_Bool
+_rules_condition_token(Rule_Parser *rp)
+{
+   static const struct
+   {
+      const char *s;
+      Rule_Op op;
+   } ops[] = {
+      { "==", RULE_OP_EQ }, { "!=", RULE_OP_NE },
+      { "=~", RULE_OP_MATCH }, { "!~", RULE_OP_NMATCH },
+      { "<=", RULE_OP_LE }, { ">=", RULE_OP_GE },
+      { "<", RULE_OP_LT }, { ">", RULE_OP_GT },
+      { NULL, 0 }
+   };
+   unsigned int i;
+
+   eina_strbuf_reset(rp->token.buf);
+
+   while (isspace((unsigned char)*rp->p))
+     rp->p++;
+
+   if (!*rp->p)
+     {
+        rp->token.type = RULE_TOKEN_END;
+        return EINA_TRUE;
+     }
+
+   if (*rp->p == '(')
+     {
+        rp->token.type = RULE_TOKEN_LPAREN;
+        rp->p++;
+        return EINA_TRUE;
+     }
+
+   if (*rp->p == ')')
+     {
+        rp->token.type = RULE_TOKEN_RPAREN;
+        rp->p++;
+        return EINA_TRUE;
+     }
+
+   if ((!strncmp(rp->p, "&&", 2)) || (!strncmp(rp->p, "||", 2)))
+     {
+        rp->token.type = (*rp->p == '&') ? RULE_TOKEN_AND : RULE_TOKEN_OR;
+        rp->p += 2;
+        return EINA_TRUE;
+     }
+
+   for (i = 0; ops[i].s; i++)
+     {
+        size_t len = strlen(ops[i].s);
+
+        if (strncmp(rp->p, ops[i].s, len))
+          continue;
+
+        rp->token.type = RULE_TOKEN_OP;
+        rp->token.op = ops[i].op;
+        rp->p += len;
+        return EINA_TRUE;
+     }
+
+   if (*rp->p == '!')
+     {
+        rp->token.type = RULE_TOKEN_NOT;
+        rp->p++;
+        return EINA_TRUE;
+     }
+
+   if (*rp->p == '"')
+     {
+        for (rp->p++; (*rp->p) && (*rp->p != '"'); rp->p++)
+          {
+             if ((*rp->p == '\\') && (rp->p[1]))
+               rp->p++;
+             eina_strbuf_append_char(rp->token.buf, *rp->p);
+          }
+
+        if (*rp->p != '"')
+          {
+             rp->error = "Unterminated string";
+             return EINA_FALSE;
+          }
+        rp->p++;
+        rp->token.type = RULE_TOKEN_STRING;
+        return EINA_TRUE;
+     }
+
+   for (; (*rp->p) && (!isspace((unsigned char)*rp->p)) && (!strchr("()\"=!<>&|", *rp->p));
+        rp->p++)
+     eina_strbuf_append_char(rp->token.buf, *rp->p);
+
+   if (!eina_strbuf_length_get(rp->token.buf))
+     {
+        rp->error = "Unexpected character";
+        return EINA_FALSE;
+     }
+
+   rp->token.type = RULE_TOKEN_WORD;
+   if (!strcmp(eina_strbuf_string_get(rp->token.buf), "and"))
+     rp->token.type = RULE_TOKEN_AND;
+   else if (!strcmp(eina_strbuf_string_get(rp->token.buf), "or"))
+     rp->token.type = RULE_TOKEN_OR;
+   else if (!strcmp(eina_strbuf_string_get(rp->token.buf), "not"))
+     rp->token.type = RULE_TOKEN_NOT;
+   else if (!strcmp(eina_strbuf_string_get(rp->token.buf), "in"))
+     {
+        rp->token.type = RULE_TOKEN_OP;
+        rp->token.op = RULE_OP_IN;
+     }
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Parses the value of a predicate according to its operator.
+ * @param pred Rule_Predicate to fill.
+ * @return EINA_FALSE if the value is invalid for the operator.
+ */
+static Eina_Bool
+_rules_predicate_value(Rule_Predicate *pred)
+{
+   const char *s;
+   char *end;
+
+   switch (pred->op)
+     {
+      case RULE_OP_EQ:
+      case RULE_OP_NE:
+        pred->cost += 1;
+        pred->v.num = strtod(pred->value, &end);
+        pred->numeric = ((pred->field == RULE_FIELD_PID) &&
+                         (*pred->value) && (!*end));
+        return EINA_TRUE;
+      case RULE_OP_LT:
+      case RULE_OP_LE:
+      case RULE_OP_GT:
+      case RULE_OP_GE:
+        pred->cost += 1;
+        pred->v.num = strtod(pred->value, &end);
+        pred->numeric = EINA_TRUE;
+        return ((*pred->value) && (!*end));
+      case RULE_OP_MATCH:
+      case RULE_OP_NMATCH:
+        pred->cost += 10;
+        return !regcomp(&pred->v.preg, pred->value, REG_EXTENDED | REG_NOSUB);
+      case RULE_OP_IN:
+        pred->cost += 1;
+        s = strchr(pred->value, '/');
+        if (s)
+          {
+             struct in_addr addr;
+             char ip[INET_ADDRSTRLEN];
+             long bits;
+
+             if ((size_t)(s - pred->value) >= sizeof(ip))
+               return EINA_FALSE;
+             memcpy(ip, pred->value, s - pred->value);
+             ip[s - pred->value] = 0;
+
+             bits = strtol(s + 1, &end, 10);
+             if ((*end) || (bits < 0) || (bits > 32) ||
+                 (inet_pton(AF_INET, ip, &addr) != 1))
+               return EINA_FALSE;
+
+             pred->cidr = EINA_TRUE;
+             pred->v.cidr.mask = (bits) ? (0xffffffffU << (32 - bits)) : 0;
+             pred->v.cidr.net = ntohl(addr.s_addr) & pred->v.cidr.mask;
+             return EINA_TRUE;
+          }
+
+        s = strstr(pred->value, "..");
+        if (!s)
+          return EINA_FALSE;
+
+        {
+           char min[32];
+
+           if ((s == pred->value) || ((size_t)(s - pred->value) >= sizeof(min)))
+             return EINA_FALSE;
+           memcpy(min, pred->value, s - pred->value);
+           min[s - pred->value] = 0;
+
+           pred->numeric = EINA_TRUE;
+           pred->v.range.min = strtod(min, &end);
+           if (*end)
+             return EINA_FALSE;
+           pred->v.range.max = strtod(s + 2, &end);
+           return ((s[2]) && (!*end));
+        }
+     }
+   return EINA_FALSE;
+}
+
+/**
+ * @brief Returns the predicate matching field, operator and value.
+ * @param rp Rule_Parser structure.
+ * @param field Field to test.
+ * @param cost Cost of reading the field.
+ * @param op Operator.
+ * @param value Value to compare the field to.
+ * @return Rule_Predicate shared by all the rules using the same test.
+ *
+ * Predicates are stored in the Rules structure, so the same test written
+ * in several conditions, or several times in one condition, is only
+ * evaluated once per line.
+ */
+static Rule_Predicate *
+_rules_predicate_get(Rule_Parser *rp,
+                     Rule_Field field,
+                     unsigned int cost,
+                     Rule_Op op,
+                     const char *value)
+{
+   Rule_Predicate *pred;
+   char *key;
+   int len;
+
+   len = asprintf(&key, "%i %i %s", field, op, value);
+   if (len < 0)
+     return NULL;
+
+   pred = eina_hash_find(rp->rules->predicates, key);
+   if (pred)
+     goto pred_end;
+
+   pred = calloc(1, sizeof(Rule_Predicate));
+   if (!pred)
+     goto pred_end;
+
+   pred->field = field;
+   pred->op = op;
+   pred->cost = cost;
+   pred->value = strdup(value);
+   pred->value_len = strlen(value);
+
+   if (!_rules_predicate_value(pred))
+     {
+        rp->error = "Invalid value for operator";
+        rules_predicate_free(pred);
+        pred = NULL;
+        goto pred_end;
+     }
+
+   eina_hash_add(rp->rules->predicates, key, pred);
+
+pred_end:
+   free(key);
+   return pred;
+}
+
+static Rule_Node *
+_rules_condition_parse_predicate(Rule_Parser *rp)
+{
+   Rule_Node *node;
+   Rule_Field field;
+   Rule_Op op;
+   unsigned int i,
+                cost;
+
+   if (rp->token.type != RULE_TOKEN_WORD)
+     {
+        rp->error = "Field name expected";
+        return NULL;
+     }
+
+   for (i = 0; _rules_fields[i].name; i++)
+     if (!strcmp(_rules_fields[i].name, eina_strbuf_string_get(rp->token.buf)))
+       break;
+
+   if (!_rules_fields[i].name)
+     {
+        rp->error = "Unknown field";
+        return NULL;
+     }
+
+   field = _rules_fields[i].field;
+   cost = _rules_fields[i].cost;
+
+   if ((!_rules_condition_token(rp)) || (rp->token.type != RULE_TOKEN_OP))
+     {
+        if (!rp->error) rp->error = "Operator expected";
+        return NULL;
+     }
+   op = rp->token.op;
+
+   if ((!_rules_condition_token(rp)) ||
+       ((rp->token.type != RULE_TOKEN_WORD) &&
+        (rp->token.type != RULE_TOKEN_STRING)))
+     {
+        if (!rp->error) rp->error = "Value expected";
+        return NULL;
+     }
+
+   node = calloc(1, sizeof(Rule_Node));
+   if (!node)
+     {
+        rp->error = "Out of memory";
+        return NULL;
+     }
+
+   node->type = RULE_NODE_PRED;
+   node->pred = _rules_predicate_get(rp, field, cost, op,
+                                     eina_strbuf_string_get(rp->token.buf));
+   if (!node->pred)
+     {
+        free(node);
+        return NULL;
+     }
+   node->cost = node->pred->cost;
+
+   if (!_rules_condition_token(rp))
+     {
+        free(node);
+        return NULL;
+     }
+   return node;
+}
+
+static Rule_Node *
+_rules_condition_parse_not(Rule_Parser *rp)
+{
+   Rule_Node *node,
+             *child;
+
+   if (rp->token.type == RULE_TOKEN_NOT)
+     {
+        if (!_rules_condition_token(rp))
+          return NULL;
+
+        child = _rules_condition_parse_not(rp);
+        if (!child)
+          return NULL;
+
+        /* not not x is x */
+        if (child->type == RULE_NODE_NOT)
+          {
+             node = eina_list_data_get(child->children);
+             child->children = eina_list_free(child->children);
+             free(child);
+             return node;
+          }
+
+        node = calloc(1, sizeof(Rule_Node));
+        if (!node)
+          {
+             rp->error = "Out of memory";
+             _rules_node_free(child);
+             return NULL;
+          }
+        node->type = RULE_NODE_NOT;
+        node->children = eina_list_append(NULL, child);
+        node->cost = child->cost;
+        return node;
+     }
+
+   if (rp->token.type == RULE_TOKEN_LPAREN)
+     {
+        if (!_rules_condition_token(rp))
+          return NULL;
+
+        node = _rules_condition_parse_or(rp);
+        if (!node)
+          return NULL;
+
+        if (rp->token.type != RULE_TOKEN_RPAREN)
+          {
+             rp->error = "Missing closing parenthesis";
+             _rules_node_free(node);
+             return NULL;
+          }
+
+        if (!_rules_condition_token(rp))
+          {
+             _rules_node_free(node);
+             return NULL;
+          }
+        return node;
+     }
+
+   return _rules_condition_parse_predicate(rp);
+}
+
+static int
+_rules_node_cost_cmp(const void *d1,
+                     const void *d2)
+{
+   const Rule_Node *n1 = d1,
+                   *n2 = d2;
+
+   return (int)n1->cost - (int)n2->cost;
+}
+
+/**
+ * @brief Parses a list of operands joined by the same boolean operator.
+ * @param rp Rule_Parser structure.
+ * @param type RULE_NODE_AND or RULE_NODE_OR.
+ * @return Rule_Node, with operands sorted by increasing cost.
+ *
+ * Nested operators of the same type are flattened, so that
+ * (a and b) and c can be reordered as a whole.
+ */
+static Rule_Node *
+_rules_condition_parse_list(Rule_Parser *rp,
+                            Rule_Node_Type type)
+{
+   Rule_Node *node,
+             *child;
+   Rule_Token_Type token;
+   Eina_List *l;
+
+   token = (type == RULE_NODE_AND) ? RULE_TOKEN_AND : RULE_TOKEN_OR;
+
+   child = (type == RULE_NODE_AND) ? _rules_condition_parse_not(rp) :
+                                     _rules_condition_parse_list(rp, RULE_NODE_AND);
+   if ((!child) || (rp->token.type != token))
+     return child;
+
+   node = calloc(1, sizeof(Rule_Node));
+   if (!node)
+     {
+        rp->error = "Out of memory";
+        _rules_node_free(child);
+        return NULL;
+     }
+   node->type = type;
+
+   while (1)
+     {
+        if (child->type == type)
+          {
+             node->children = eina_list_merge(node->children, child->children);
+             child->children = NULL;
+             _rules_node_free(child);
+          }
+        else
+          node->children = eina_list_append(node->children, child);
+
+        if (rp->token.type != token)
+          break;
+
+        if (!_rules_condition_token(rp))
+          goto list_error;
+
+        child = (type == RULE_NODE_AND) ? _rules_condition_parse_not(rp) :
+                                          _rules_condition_parse_list(rp, RULE_NODE_AND);
+        if (!child)
+          goto list_error;
+     }
+
+   node->children = eina_list_sort(node->children, 0, _rules_node_cost_cmp);
+   EINA_LIST_FOREACH(node->children, l, child)
+     node->cost += child->cost;
+   return node;
+
+list_error:
+   _rules_node_free(node);
+   return NULL;
+}
+
+static Rule_Node *
+_rules_condition_parse_or(Rule_Parser *rp)
+{
+   return _rules_condition_parse_list(rp, RULE_NODE_OR);
+}
+
+static unsigned int
+_rules_condition_size(Rule_Node *node)
+{
+   Rule_Node *child;
+   Eina_List *l;
+   unsigned int size = 0;
+
+   switch (node->type)
+     {
+      case RULE_NODE_PRED:
+        return 1;
+      case RULE_NODE_NOT:
+        return _rules_condition_size(eina_list_data_get(node->children)) + 1;
+      default:
+        EINA_LIST_FOREACH(node->children, l, child)
+          size += _rules_condition_size(child) + 1;
+        return size - 1;
+     }
+}
+
+/**
+ * @brief Writes the bytecode of a node.
+ * @param rc Rule_Condition to write to.
+ * @param node Node to compile.
+ * @param pos Position of the next instruction, updated.
+ *
+ * Operands of and/or are followed by a conditional jump to the end of
+ * the list, so evaluation stops as soon as the result is known.
+ */
+static void
+_rules_condition_emit(Rule_Condition *rc,
+                      Rule_Node *node,
+                      unsigned int *pos)
+{
+   Rule_Node *child;
+   Eina_List *l,
+             *jumps = NULL;
+   Rule_Code *code;
+
+   switch (node->type)
+     {
+      case RULE_NODE_PRED:
+        rc->code[*pos].op = RULE_CODE_PRED;
+        rc->code[*pos].pred = node->pred;
+        (*pos)++;
+        return;
+      case RULE_NODE_NOT:
+        _rules_condition_emit(rc, eina_list_data_get(node->children), pos);
+        rc->code[*pos].op = RULE_CODE_NOT;
+        (*pos)++;
+        return;
+      default:
+        break;
+     }
+
+   EINA_LIST_FOREACH(node->children, l, child)
+     {
+        _rules_condition_emit(rc, child, pos);
+        if (!eina_list_next(l))
+          break;
+
+        rc->code[*pos].op = (node->type == RULE_NODE_AND) ?
+                            RULE_CODE_JMP_FALSE : RULE_CODE_JMP_TRUE;
+        jumps = eina_list_append(jumps, &rc->code[*pos]);
+        (*pos)++;
+     }
+
+   EINA_LIST_FREE(jumps, code)
+     code->jump = *pos;
+}
+
+/**
+ * @brief Finds the first IPv4 address of the message.
+ * @param ev Rule_Event structure.
+ *
+ * Done only once per line, and only if a condition asks for the ip field.
+ */
+static void
+_rules_event_ip(Rule_Event *ev)
+{
+   const char *p,
+              *s;
+   unsigned int i,
+                n,
+                digits;
+   uint32_t addr;
+
+   ev->ip.done = EINA_TRUE;
+   if (!ev->message)
+     return;
+
+   for (p = ev->message; *p; p++)
+     {
+        if ((!isdigit((unsigned char)*p)) ||
+            ((p != ev->message) &&
+             ((isalnum((unsigned char)p[-1])) || (p[-1] == '.'))))
+          continue;
+
+        s = p;
+        addr = 0;
+        for (i = 0; i < 4; i++)
+          {
+             for (n = 0, digits = 0; (isdigit((unsigned char)*s)) && (digits < 4); s++, digits++)
+               n = n * 10 + (*s - '0');
+
+             if ((!digits) || (digits > 3) || (n > 255))
+               break;
+
+             addr = (addr << 8) | n;
+             if (i == 3)
+               break;
+             if (*s != '.')
+               break;
+             s++;
+          }
+
+        if ((i != 3) || (isalnum((unsigned char)*s)) ||
+            ((*s == '.') && (isdigit((unsigned char)s[1]))))
+          continue;
+
+        ev->ip.s = p;
+        ev->ip.len = s - p;
+        ev->ip.addr = addr;
+        return;
+     }
+}
+
+/**
+ * @brief Returns the value of a field of the event.
+ * @param ev Rule_Event structure.
+ * @param field Field to get.
+ * @param buf Buffer used when the field has to be rendered.
+ * @param len Length of the field, set by this function.
+ * @return Pointer to the field, that may not be NUL terminated.
+ */
+static const char *
+_rules_event_field(Rule_Event *ev,
+                   Rule_Field field,
+                   char *buf,
+                   size_t *len)
+{
+   const char *s = NULL;
+
+   *len = 0;
+   switch (field)
+     {
+      case RULE_FIELD_PID:
+        *len = snprintf(buf, RULES_FIELD_MAX, "%ld", ev->pid);
+        return buf;
+      case RULE_FIELD_PROGRAM:
+        *len = ev->program_len;
+        return ev->program;
+      case RULE_FIELD_HOST:
+        *len = ev->host_len;
+        return ev->host;
+      case RULE_FIELD_FILENAME:
+        s = ev->filename;
+        break;
+      case RULE_FIELD_MESSAGE:
+        s = ev->message;
+        break;
+      case RULE_FIELD_LINE:
+        s = ev->line;
+        break;
+      case RULE_FIELD_IP:
+        if (!ev->ip.done)
+          _rules_event_ip(ev);
+        *len = ev->ip.len;
+        return ev->ip.s;
+     }
+
+   if (s)
+     *len = strlen(s);
+   return s;
+}
+
+/**
+ * @brief Returns a NUL terminated copy of a field, if it is not already.
+ */
+static const char *
+_rules_field_terminate(Rule_Field field,
+                       const char *s,
+                       size_t len,
+                       char *buf)
+{
+   if ((field == RULE_FIELD_MESSAGE) || (field == RULE_FIELD_LINE) ||
+       (field == RULE_FIELD_FILENAME) || (field == RULE_FIELD_PID))
+     return s;
+
+   if (len >= RULES_FIELD_MAX)
+     len = RULES_FIELD_MAX - 1;
+   memcpy(buf, s, len);
+   buf[len] = 0;
+   return buf;
+}
+
+static Eina_Bool
+_rules_predicate_eval(Rule_Predicate *pred,
+                      Rule_Event *ev)
+{
+   char buf[RULES_FIELD_MAX],
+        tmp[RULES_FIELD_MAX];
+   const char *s;
+   size_t len;
+   double num = 0.0;
+   Eina_Bool r = EINA_FALSE;
+
+   if (pred->gen == ev->gen)
+     return pred->result;
+
+   s = _rules_event_field(ev, pred->field, buf, &len);
+   if (!s)
+     goto pred_end;
+
+   if (pred->numeric)
+     num = (pred->field == RULE_FIELD_PID) ?
+           (double)ev->pid :
+           strtod(_rules_field_terminate(pred->field, s, len, tmp), NULL);
+
+   switch (pred->op)
+     {
+      case RULE_OP_EQ:
+      case RULE_OP_NE:
+        if (pred->numeric)
+          r = (num == pred->v.num);
+        else
+          r = ((len == pred->value_len) && (!memcmp(s, pred->value, len)));
+        if (pred->op == RULE_OP_NE)
+          r = !r;
+        break;
+      case RULE_OP_LT:
+        r = (num < pred->v.num);
+        break;
+      case RULE_OP_LE:
+        r = (num <= pred->v.num);
+        break;
+      case RULE_OP_GT:
+        r = (num > pred->v.num);
+        break;
+      case RULE_OP_GE:
+        r = (num >= pred->v.num);
+        break;
+      case RULE_OP_MATCH:
+      case RULE_OP_NMATCH:
+        r = !regexec(&pred->v.preg,
+                     _rules_field_terminate(pred->field, s, len, tmp),
+                     0, NULL, 0);
+        if (pred->op == RULE_OP_NMATCH)
+          r = !r;
+        break;
+      case RULE_OP_IN:
+        if (!pred->cidr)
+          {
+             r = ((num >= pred->v.range.min) && (num <= pred->v.range.max));
+             break;
+          }
+
+        if (pred->field == RULE_FIELD_IP)
+          r = ((ev->ip.addr & pred->v.cidr.mask) == pred->v.cidr.net);
+        else
+          {
+             struct in_addr addr;
+
+             if (inet_pton(AF_INET, _rules_field_terminate(pred->field, s,
+                                                           len, tmp),
+                           &addr) == 1)
+               r = ((ntohl(addr.s_addr) & pred->v.cidr.mask) ==
+                    pred->v.cidr.net);
+          }
+        break;
+     }
+
+pred_end:
+   pred->gen = ev->gen;
+   pred->result = r;
+   return r;
+}
+
+/**
+ * @brief Frees a predicate.
+ * @param data Rule_Predicate structure to free.
+ */
+void
+rules_predicate_free(void *data)
+{
+   Rule_Predicate *pred = data;
+
+   if ((pred->op == RULE_OP_MATCH) || (pred->op == RULE_OP_NMATCH))
+     regfree(&pred->v.preg);
+   free((char *)pred->value);
+   free(pred);
+}
+
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Compiles a condition.
+ *
+ * @param rules Rules structure holding the shared predicates.
+ * @param expr Condition to compile, like :
+ *             program == sshd and (message =~ "Failed" or
+ *             message =~ "Invalid") and not ip in 10.0.0.0/8
+ * @return Compiled condition, or NULL if expr is invalid.
+ *
+ * Fields are pid, program, host, file, message, line and ip (the first
+ * IPv4 address of the message).<br />
+ * Operators are ==, !=, <, <=, >, >=, =~ (regex), !~, in (CIDR or
+ * numeric range like 100..200), combined with and, or, not (or &&, ||, !).
+ */
+Rule_Condition *
+rules_condition_new(Rules *rules,
+                    const char *expr)
+{
+   Rule_Parser rp;
+   Rule_Node *node = NULL;
+   Rule_Condition *rc = NULL;
+   unsigned int size,
+                pos = 0;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(rules, NULL);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(expr, NULL);
+
+   memset(&rp, 0, sizeof(Rule_Parser));
+   rp.rules = rules;
+   rp.p = expr;
+   rp.token.buf = eina_strbuf_new();
+
+   if (!_rules_condition_token(&rp))
+     goto condition_end;
+
+   node = _rules_condition_parse_or(&rp);
+   if (!node)
+     goto condition_end;
+
+   if (rp.token.type != RULE_TOKEN_END)
+     {
+        rp.error = "Trailing characters";
+        goto condition_end;
+     }
+
+   size = _rules_condition_size(node);
+   rc = calloc(1, sizeof(Rule_Condition) + size * sizeof(Rule_Code));
+   if (!rc)
+     goto condition_end;
+
+   rc->size = size;
+   _rules_condition_emit(rc, node, &pos);
+   DBG("Compiled \"%s\" to %u instructions", expr, size);
+
+condition_end:
+   if (rp.error)
+     ERR("Failed to compile condition \"%s\" : %s near \"%s\"",
+         expr, rp.error, rp.p);
+   _rules_node_free(node);
+   eina_strbuf_free(rp.token.buf);
+   return rc;
+}
+
+/**
+ * @brief Frees a compiled condition.
+ *
+ * @param rc Rule_Condition to free.
+ *
+ * The predicates are kept until rules_purge().
+ */
+void
+rules_condition_free(Rule_Condition *rc)
+{
+   free(rc);
+}
+
+/**
+ * @brief Evaluates a compiled condition against an event.
+ *
+ * @param rc Rule_Condition to evaluate.
+ * @param ev Rule_Event, initialized with rules_event_init().
+ * @return EINA_TRUE if the event matches the condition.
+ */
+Eina_Bool
+rules_condition_eval(Rule_Condition *rc,
+                     Rule_Event *ev)
+{
+   Eina_Bool acc = EINA_TRUE;
+   unsigned int i = 0;
+
+   while (i < rc->size)
+     {
+        Rule_Code *code = &rc->code[i++];
+
+        switch (code->op)
+          {
+           case RULE_CODE_PRED:
+             acc = _rules_predicate_eval(code->pred, ev);
+             break;
+           case RULE_CODE_NOT:
+             acc = !acc;
+             break;
+           case RULE_CODE_JMP_FALSE:
+             if (!acc) i = code->jump;
+             break;
+           case RULE_CODE_JMP_TRUE:
+             if (acc) i = code->jump;
+             break;
+          }
+     }
+   return acc;
+}
+
+/**
+ * @brief Prepares a Rule_Event for a new line.
+ *
+ * @param ev Rule_Event to reset.
+ *
+ * Predicate results are cached per event, so every line must use
+ * a freshly initialized Rule_Event.
+ */
+void
+rules_event_init(Rule_Event *ev)
+{
+   memset(ev, 0, sizeof(Rule_Event));
+   ev->gen = ++_rules_event_gen;
+}
+
+/**
+ * @}
+ */
@@ -61,9 +61,15 @@ rules_load_rule(void *data,
              for (i = 0; tags[i]; i++)
                {
                   Eina_Strbuf *buf = eina_strbuf_new();
+                  int id;
 
                   eina_strbuf_append(buf, tags[i]);
                   eina_strbuf_trim(buf);
+
+                  id = rules_tag_intern(rl->rules, eina_strbuf_string_get(buf));
+                  if (id >= 0)
+                    RULE_TAGS_SET(&rule->spec.tagset, id);
+
                   rule->spec.tags = eina_list_append(rule->spec.tags,
                                                  eina_strbuf_string_steal(buf));
                   eina_strbuf_free(buf);
@@ -75,8 +81,44 @@ rules_load_rule(void *data,
           rule->spec.source_host = strdup(value);
         else if (!strcmp(variable, "source_path"))
           rule->spec.source_path = strdup(value);
+        else if (!strcmp(variable, "program"))
+          rule->spec.program = strdup(value);
         else if (!strcmp(variable, "delete"))
           rule->spec.todel = !!atoi(value);
+        else if (!strcmp(variable, "sample"))
+          rule->spec.sample = strtoul(value, NULL, 10);
+        else if (!strcmp(variable, "rate_limit"))
+          {
+             rule->spec.rate_limit = strtod(value, NULL);
+             rule->limit.tokens = (rule->spec.rate_limit < 1.0) ?
+                               1.0 : rule->spec.rate_limit;
+          }
+        else if (!strcmp(variable, "dedup"))
+          rule->spec.dedup = strtod(value, NULL);
+        else if (!strcmp(variable, "index"))
+          rule->spec.index = strdup(value);
+        else if (!strcmp(variable, "priority"))
+          rule->spec.priority = !strcmp(value, "high");
+        else if ((!strncmp(variable, "field.", 6)) && (variable[6]))
+          {
+             Rule_Static_Field *rsf;
+
+             rsf = calloc(1, sizeof(Rule_Static_Field));
+             rsf->name = strdup(variable + 6);
+             rsf->value = strdup(value);
+             rule->spec.fields = eina_list_append(rule->spec.fields, rsf);
+          }
+        else if (!strcmp(variable, "condition"))
+          {
+             rule->spec.condition = rules_condition_new(rl->rules, value);
+             if (!rule->spec.condition)
+               {
+                  ERR("Invalid condition \"%s\", dropping rule.", value);
+                  eina_iterator_free(it);
+                  rules_rule_free(rule);
+                  return;
+               }
+          }
 
         else if (!strncmp(variable, "message", 7))
         {
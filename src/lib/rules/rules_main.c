@@ -24,6 +24,7 @@ int _rules_log_dom_global = -1;
 void
 rules_rule_free(Rule *rule)
 {
+   Rule_Static_Field *rsf;
    char *s;
    EINA_SAFETY_ON_NULL_RETURN(rule);
 
@@ -31,9 +32,19 @@ rules_rule_free(Rule *rule)
    free((char *)rule->spec.filename);
    free((char *)rule->spec.source_host);
    free((char *)rule->spec.source_path);
+   free((char *)rule->spec.program);
+   free((char *)rule->spec.index);
 
    EINA_LIST_FREE(rule->spec.tags, s)
      free(s);
+   rules_condition_free(rule->spec.condition);
+
+   EINA_LIST_FREE(rule->spec.fields, rsf)
+     {
+        free((char *)rsf->name);
+        free((char *)rsf->value);
+        free(rsf);
+     }
 
    while (rule->spec.regex)
      {
@@ -60,6 +71,8 @@ rules_new(const char *directory)
 
    rules = calloc(1, sizeof(Rules));
    rules->directory = strdup(directory);
+   rules->predicates = eina_hash_string_superfast_new(rules_predicate_free);
+   rules->tags.ids = eina_hash_string_superfast_new(NULL);
    return rules;
 }
 
@@ -77,6 +90,81 @@ rules_purge(Rules *rules)
         rules->rules = eina_inlist_remove(rules->rules, rules->rules);
         rules_rule_free(rule);
      }
+
+   eina_hash_free(rules->predicates);
+   rules->predicates = eina_hash_string_superfast_new(rules_predicate_free);
+
+   eina_hash_free(rules->tags.ids);
+   rules->tags.ids = eina_hash_string_superfast_new(NULL);
+   while (rules->tags.count)
+     free((char *)rules->tags.names[--rules->tags.count]);
+}
+
+/**
+ * @brief Returns the id of a tag, registering it if needed.
+ *
+ * @param rules Rules structure.
+ * @param tag Tag name.
+ * @return Id of the tag, or -1 if RULES_TAGS_MAX tags are already known.
+ *
+ * Ids are small integers, given in registration order, that can be
+ * used in a Rule_Tags bitset. They are reset by rules_purge().
+ */
+int
+rules_tag_intern(Rules *rules,
+                 const char *tag)
+{
+   uintptr_t id;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(rules, -1);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(tag, -1);
+
+   id = (uintptr_t)eina_hash_find(rules->tags.ids, tag);
+   if (id)
+     return (int)(id - 1);
+
+   if (rules->tags.count == RULES_TAGS_MAX)
+     {
+        ERR("Too many tags, ignoring \"%s\"", tag);
+        return -1;
+     }
+
+   id = rules->tags.count;
+   rules->tags.names[id] = strdup(tag);
+   rules->tags.count++;
+   eina_hash_add(rules->tags.ids, tag, (void *)(id + 1));
+   return (int)id;
+}
+
+/**
+ * @brief Returns the name of a tag.
+ *
+ * @param rules Rules structure.
+ * @param id Id of the tag, as returned by rules_tag_intern().
+ * @return Name of the tag, or NULL if id is unknown.
+ */
+const char *
+rules_tag_name_get(Rules *rules,
+                   unsigned int id)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(rules, NULL);
+
+   if (id >= rules->tags.count)
+     return NULL;
+   return rules->tags.names[id];
+}
+
+/**
+ * @brief Returns the number of known tags.
+ *
+ * @param rules Rules structure.
+ * @return Number of tags, valid ids are below it.
+ */
+unsigned int
+rules_tags_count(Rules *rules)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(rules, 0);
+   return rules->tags.count;
 }
 
 /**
@@ -1,5 +1,9 @@
 #include <Rules.h>
 
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
 extern int _rules_log_dom_global;
 
 #define ERR(...) EINA_LOG_DOM_ERR(_rules_log_dom_global, __VA_ARGS__)
@@ -8,10 +12,95 @@ extern int _rules_log_dom_global;
 #define WRN(...) EINA_LOG_DOM_WARN(_rules_log_dom_global, __VA_ARGS__)
 #define CRI(...) EINA_LOG_DOM_CRIT(_rules_log_dom_global, __VA_ARGS__)
 
+#define RULES_FIELD_MAX 256
+
 struct _Rules
 {
    const char *directory;
    Eina_Inlist *rules;
+   Eina_Hash *predicates; /* Shared by all the conditions */
+
+   struct
+   {
+      Eina_Hash *ids; /* name -> id + 1 */
+      const char *names[RULES_TAGS_MAX];
+      unsigned int count;
+   } tags;
+};
+
+typedef enum _Rule_Field
+{
+   RULE_FIELD_PID,
+   RULE_FIELD_PROGRAM,
+   RULE_FIELD_HOST,
+   RULE_FIELD_FILENAME,
+   RULE_FIELD_MESSAGE,
+   RULE_FIELD_LINE,
+   RULE_FIELD_IP
+} Rule_Field;
+
+typedef enum _Rule_Op
+{
+   RULE_OP_EQ,
+   RULE_OP_NE,
+   RULE_OP_LT,
+   RULE_OP_LE,
+   RULE_OP_GT,
+   RULE_OP_GE,
+   RULE_OP_MATCH,
+   RULE_OP_NMATCH,
+   RULE_OP_IN
+} Rule_Op;
+
+typedef struct _Rule_Predicate
+{
+   Rule_Field field;
+   Rule_Op op;
+   const char *value;
+   size_t value_len;
+   unsigned int cost; /* Estimated cost, cheap predicates run first */
+   Eina_Bool numeric : 1;
+   Eina_Bool cidr : 1;
+
+   union
+   {
+      double num;
+      regex_t preg;
+      struct
+      {
+         double min,
+                max;
+      } range;
+      struct
+      {
+         uint32_t net,
+                  mask;
+      } cidr;
+   } v;
+
+   unsigned long gen; /* Rule_Event generation of the cached result */
+   Eina_Bool result;
+} Rule_Predicate;
+
+typedef enum _Rule_Code_Op
+{
+   RULE_CODE_PRED, /* acc = predicate */
+   RULE_CODE_NOT, /* acc = !acc */
+   RULE_CODE_JMP_FALSE, /* if (!acc) goto jump */
+   RULE_CODE_JMP_TRUE /* if (acc) goto jump */
+} Rule_Code_Op;
+
+typedef struct _Rule_Code
+{
+   Rule_Code_Op op;
+   unsigned int jump;
+   Rule_Predicate *pred;
+} Rule_Code;
+
+struct _Rule_Condition
+{
+   unsigned int size;
+   Rule_Code code[];
 };
 
 typedef struct _Rules_Load
@@ -44,3 +133,5 @@ Eina_Bool rules_load_ls_filter(void *data, Eio_File *handler, const Eina_File_Di
 void rules_load_ls(void *data, Eio_File *handler, const Eina_File_Direct_Info *info);
 void rules_load_ls_done(void *data, Eio_File *handler);
 void rules_load_ls_error(void *data, Eio_File *handler, int error);
+
+void rules_predicate_free(void *data);
@@ -71,12 +71,14 @@ _spy_file_job(void *data)
  * This function is called by spy_file_cb(), and thus, running from
  * a thread.<br />
  * For each line found, this function will initiate a SPY_EVENT_LINE
- * event from the main loop.
+ * event from the main loop.<br />
+ * Lines get their position in the file, and an id hashed from it.
  */
 void
 _spy_file_line_extract(Spy_File *sf)
 {
    Spy_Line *sl;
+   uint64_t key[4];
 
    DBG("sf[%p]", sf);
 
@@ -93,6 +95,8 @@ _spy_file_line_extract(Spy_File *sf)
         if (sf->extract.p == sf->extract.s)
           {
              eina_strbuf_remove(sf->read.buf, 0, 1);
+             sf->extract.offset++;
+             sf->extract.line++;
              continue;
           }
 
@@ -107,8 +111,19 @@ _spy_file_line_extract(Spy_File *sf)
 
         sl->sf = sf;
         sl->line = strndup(sf->extract.s, sf->extract.l);
+        sl->hash = spy_line_hash(sf->extract.s, sf->extract.l);
+        sl->offset = sf->extract.offset;
+        sl->number = ++sf->extract.line;
+
+        key[0] = sf->read.dev;
+        key[1] = sf->read.ino;
+        key[2] = sl->offset;
+        key[3] = sl->hash;
+        spy_line_id(sf->spy->seed, key, sl->id);
+
         ecore_main_loop_thread_safe_call_async(_spy_file_event, sl);
-        eina_strbuf_remove(sf->read.buf, 0, sf->extract.l);
+        eina_strbuf_remove(sf->read.buf, 0, sf->extract.l + 1);
+        sf->extract.offset += sf->extract.l + 1;
      }
 }
 
@@ -126,6 +141,8 @@ _spy_file_cb(void *data,
              Ecore_Thread *thread EINA_UNUSED)
 {
    Spy_File *sf = data;
+   struct stat st;
+   off_t buffered;
 
    sf = data;
    DBG("sf[%p]", sf);
@@ -140,6 +157,17 @@ _spy_file_cb(void *data,
         return;
      }
 
+   if (!fstat(sf->read.fd, &st))
+     {
+        sf->read.dev = st.st_dev;
+        sf->read.ino = st.st_ino;
+     }
+
+   /* A partial line of the last read is still buffered */
+   buffered = eina_strbuf_length_get(sf->read.buf);
+   sf->extract.offset = (sf->read.offset > buffered) ?
+      sf->read.offset - buffered : 0;
+
    sf->read.databuf = calloc(1, sf->read.length + 1);
 
    errno = 0;
@@ -247,6 +275,7 @@ spy_file_poll(void *data)
      {
          DBG("spy_file[%p] File trunc!", sf);
          sf->poll.size = 0;
+         sf->extract.line = 0;
 
          if (!size)
            return EINA_TRUE;
@@ -5,6 +5,125 @@
  * @{
  */
 
+/**
+ * @cond IGNORE
+ */
+
+/**
+ * @brief Computes the fingerprint of a line.
+ * @param s Line to hash.
+ * @param len Length of @p s.
+ * @return 64 bits hash of the line.
+ *
+ * This is MurmurHash64A, it works 8 bytes at a time and is called
+ * from the reading thread, so the main loop gets it for free.
+ */
+uint64_t
+spy_line_hash(const char *s,
+              size_t len)
+{
+   const uint64_t m = 0xc6a4a7935bd1e995ULL;
+   const int r = 47;
+   uint64_t h = 0x5bd1e995ULL ^ (len * m),
+            k;
+   const unsigned char *p = (const unsigned char *)s,
+                       *end = p + (len & ~(size_t)7);
+
+   for (; p != end; p += 8)
+     {
+        memcpy(&k, p, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+     }
+
+   switch (len & 7)
+     {
+      case 7: h ^= (uint64_t)p[6] << 48; /* Falls through */
+      case 6: h ^= (uint64_t)p[5] << 40; /* Falls through */
+      case 5: h ^= (uint64_t)p[4] << 32; /* Falls through */
+      case 4: h ^= (uint64_t)p[3] << 24; /* Falls through */
+      case 3: h ^= (uint64_t)p[2] << 16; /* Falls through */
+      case 2: h ^= (uint64_t)p[1] << 8; /* Falls through */
+      case 1: h ^= (uint64_t)p[0];
+              h *= m;
+     }
+
+   h ^= h >> r;
+   h *= m;
+   h ^= h >> r;
+   return h;
+}
+
+#define SPY_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t
+_spy_line_fmix64(uint64_t k)
+{
+   k ^= k >> 33;
+   k *= 0xff51afd7ed558ccdULL;
+   k ^= k >> 33;
+   k *= 0xc4ceb9fe1a85ec53ULL;
+   k ^= k >> 33;
+   return k;
+}
+
+/**
+ * @brief Computes the id of a line from its position.
+ * @param seed Seed of the Spy, telling hosts apart.
+ * @param key Device, inode, offset and hash of the line.
+ * @param id Set to the 128 bits id.
+ *
+ * This is MurmurHash3_x64_128 of the 32 bytes of @p key, unrolled for
+ * that length. Like spy_line_hash(), it runs in the reading thread.
+ */
+void
+spy_line_id(uint64_t seed,
+            const uint64_t key[4],
+            uint64_t id[2])
+{
+   const uint64_t c1 = 0x87c37b91114253d5ULL,
+                  c2 = 0x4cf5ad432745937fULL;
+   uint64_t h1 = seed,
+            h2 = seed,
+            k1,
+            k2;
+   unsigned int i;
+
+   for (i = 0; i < 4; i += 2)
+     {
+        k1 = key[i] * c1;
+        k1 = SPY_ROTL64(k1, 31) * c2;
+        h1 ^= k1;
+        h1 = SPY_ROTL64(h1, 27) + h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        k2 = key[i + 1] * c2;
+        k2 = SPY_ROTL64(k2, 33) * c1;
+        h2 ^= k2;
+        h2 = SPY_ROTL64(h2, 31) + h1;
+        h2 = h2 * 5 + 0x38495ab5;
+     }
+
+   h1 ^= 4 * sizeof(uint64_t);
+   h2 ^= 4 * sizeof(uint64_t);
+   h1 += h2;
+   h2 += h1;
+   h1 = _spy_line_fmix64(h1);
+   h2 = _spy_line_fmix64(h2);
+   h1 += h2;
+   h2 += h1;
+
+   id[0] = h1;
+   id[1] = h2;
+}
+
+/**
+ * @endcond
+ */
+
 /**
  * @brief Returns the line parsed by spy.
  * @param sl Spy_Line structure.
@@ -30,6 +149,60 @@ spy_line_spyfile_get(Spy_Line *sl)
    return sl->sf;
 }
 
+/**
+ * @brief Returns the fingerprint of a Spy_Line.
+ * @param sl Spy_Line structure.
+ * @return 64 bits hash of the line, computed by the reading thread.
+ *
+ * Two identical lines always have the same fingerprint.
+ */
+uint64_t
+spy_line_hash_get(Spy_Line *sl)
+{
+   return sl->hash;
+}
+
+/**
+ * @brief Returns the id of a Spy_Line.
+ * @param sl Spy_Line structure.
+ * @param id Set to the 128 bits id of the line.
+ *
+ * The id is a hash of the seed given to spy_seed_set(), the device and
+ * inode of the file, the offset of the line in it and the line itself.
+ * Reading the same line again gives the same id.
+ */
+void
+spy_line_id_get(Spy_Line *sl,
+                uint64_t id[2])
+{
+   id[0] = sl->id[0];
+   id[1] = sl->id[1];
+}
+
+/**
+ * @brief Returns the offset of a Spy_Line in its file.
+ * @param sl Spy_Line structure.
+ * @return Offset of the first byte of the line.
+ */
+off_t
+spy_line_offset_get(Spy_Line *sl)
+{
+   return sl->offset;
+}
+
+/**
+ * @brief Returns the number of a Spy_Line in its file.
+ * @param sl Spy_Line structure.
+ * @return Line number, 1 for the first line read since the file started
+ *         being spied or was truncated. Lines already in the file when
+ *         spying started are not counted.
+ */
+unsigned long
+spy_line_number_get(Spy_Line *sl)
+{
+   return sl->number;
+}
+
 /**
  * @}
  */
@@ -33,6 +33,25 @@ spy_new(void)
    return spy;
 }
 
+/**
+ * @brief Set the seed of the ids of lines.
+ *
+ * @param spy Spy structure.
+ * @param seed String telling this Spy apart, like the host name.
+ *
+ * Lines read from the same position of the same file on two hosts get
+ * different ids. It has to be set before files are read.
+ */
+void
+spy_seed_set(Spy *spy,
+             const char *seed)
+{
+   EINA_SAFETY_ON_NULL_RETURN(spy);
+   EINA_SAFETY_ON_NULL_RETURN(seed);
+
+   spy->seed = spy_line_hash(seed, strlen(seed));
+}
+
 /**
  * @brief Frees a Spy structure.
  *
@@ -86,14 +105,15 @@ spy_file_free(Spy_File *sf)
  *
  * @param sf Spy_File to pause.
  *
- * It doesnt stop its timer, but will block size checking.
+ * It doesnt stop its timer, but will block size checking.<br />
+ * Pauses nest, file is spied again once every pause got its resume.
  */
 void
 spy_file_pause(Spy_File *sf)
 {
    EINA_SAFETY_ON_NULL_RETURN(sf);
 
-   sf->poll.pause = EINA_TRUE;
+   sf->poll.pause++;
 }
 
 /**
@@ -108,7 +128,8 @@ spy_file_resume(Spy_File *sf)
 {
    EINA_SAFETY_ON_NULL_RETURN(sf);
 
-   sf->poll.pause = EINA_FALSE;
+   if (sf->poll.pause)
+     sf->poll.pause--;
 }
 
 /**
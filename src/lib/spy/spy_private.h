@@ -11,6 +11,7 @@ extern int _spy_log_dom_global;
 struct _Spy
 {
    Eina_Inlist *files;
+   uint64_t seed; /* Hash of spy_seed_set() string, mixed in line ids */
 };
 
 
@@ -25,13 +26,15 @@ struct _Spy_File
    {
       Ecore_Timer *timer;
       off_t size;
-      Eina_Bool running,
-                pause;
+      Eina_Bool running;
+      unsigned int pause; /* Nested calls to spy_file_pause() */
    } poll;
 
    struct
    {
       int fd;
+      dev_t dev; /* Device and inode of the file last read */
+      ino_t ino;
       off_t offset,
             length;
       Eina_Strbuf *buf;
@@ -45,6 +48,8 @@ struct _Spy_File
       const char *p,
                  *s;
       size_t l;
+      off_t offset; /* Offset in file of the start of read.buf */
+      unsigned long line; /* Lines extracted since start of file */
    } extract;
 };
 
@@ -52,6 +57,12 @@ struct _Spy_Line
 {
    Spy_File *sf;
    const char *line;
+   uint64_t hash,
+            id[2];
+   off_t offset;
+   unsigned long number;
 };
 
 Eina_Bool spy_file_poll(void *data);
+uint64_t spy_line_hash(const char *s, size_t len);
+void spy_line_id(uint64_t seed, const uint64_t key[4], uint64_t id[2]);
@@ -0,0 +1,211 @@
+#include "store_private.h"
+
+/**
+ * @addtogroup Lib-Store-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+/**
+ * @brief Updates the controller from the end of a request.
+ * @param store Store structure.
+ * @param sb Batch of the request.
+ * @param http_code HTTP code of the answer, 0 if there was none.
+ *
+ * AIMD : a request that failed from overload halves the window of
+ * requests in flight, a request slower than the target halves the
+ * batch scale. Faster requests grow the window by one request per
+ * window of answers, and the scale by STORE_ADAPT_STEP, as long as
+ * they were limited by them and the per-document cost keeps a full
+ * batch within the target.<br />
+ * Limits are cut at most once per round trip : requests sent before
+ * the last cut were sent with the old limits, and their answers do not
+ * cut them again.
+ */
+void
+store_adapt_done(Store *store,
+                 Store_Batch *sb,
+                 int http_code)
+{
+   double target = store->adapt.target,
+          now = ecore_time_get(),
+          rtt,
+          max_scale;
+   Eina_Bool cut;
+
+   if ((target <= 0.0) || (sb->sent <= 0.0))
+     return;
+
+   rtt = now - sb->sent;
+   cut = (sb->sent >= store->adapt.cut);
+   sb->sent = 0.0;
+
+   if (store_request_failed(http_code))
+     {
+        if (!cut)
+          return;
+
+        store->adapt.window *= STORE_ADAPT_DECREASE;
+        if (store->adapt.window < 1.0)
+          store->adapt.window = 1.0;
+        store->adapt.cut = now;
+        store->adapt.decreases++;
+        return;
+     }
+
+   store->adapt.latency = (store->adapt.latency > 0.0) ?
+      store->adapt.latency + (rtt - store->adapt.latency) * STORE_ADAPT_ALPHA :
+      rtt;
+   if (sb->count)
+     store->adapt.doc_cost = (store->adapt.doc_cost > 0.0) ?
+        store->adapt.doc_cost +
+        (rtt / sb->count - store->adapt.doc_cost) * STORE_ADAPT_ALPHA :
+        rtt / sb->count;
+
+   if (rtt > target)
+     {
+        if (!cut)
+          return;
+
+        store->adapt.scale *= STORE_ADAPT_DECREASE;
+        if (store->adapt.scale < STORE_ADAPT_MIN_SCALE)
+          store->adapt.scale = STORE_ADAPT_MIN_SCALE;
+        store->adapt.cut = now;
+        store->adapt.decreases++;
+        DBG("store[%p] Request took %.3fs, batch scale down to %.3f",
+            store, rtt, store->adapt.scale);
+        return;
+     }
+
+   /* Request was sent with the window full */
+   if ((store->queue.inflight >= (unsigned int)store->adapt.window) &&
+       (store->adapt.window < store->queue.max_inflight))
+     {
+        store->adapt.window += 1.0 / store->adapt.window;
+        if (store->adapt.window > store->queue.max_inflight)
+          store->adapt.window = store->queue.max_inflight;
+        store->adapt.increases++;
+     }
+
+   if ((!sb->full) || (store->adapt.scale >= 1.0))
+     return;
+
+   max_scale = target / (store->adapt.doc_cost * store->batch.max_docs);
+   if (store->adapt.scale + STORE_ADAPT_STEP > max_scale)
+     return;
+
+   store->adapt.scale += STORE_ADAPT_STEP;
+   if (store->adapt.scale > 1.0)
+     store->adapt.scale = 1.0;
+   store->adapt.increases++;
+}
+
+/**
+ * @brief Number of documents filling a batch.
+ * @param store Store structure.
+ * @return Max documents of a batch, scaled by the controller.
+ */
+unsigned int
+store_adapt_docs(Store *store)
+{
+   unsigned int docs;
+
+   if (store->adapt.target <= 0.0)
+     return store->batch.max_docs;
+
+   docs = store->batch.max_docs * store->adapt.scale;
+   return (docs) ? docs : 1;
+}
+
+/**
+ * @brief Size of body filling a batch.
+ * @param store Store structure.
+ * @return Max size of a batch body, scaled by the controller.
+ */
+size_t
+store_adapt_bytes(Store *store)
+{
+   size_t bytes;
+
+   if (store->adapt.target <= 0.0)
+     return store->batch.max_bytes;
+
+   bytes = store->batch.max_bytes * store->adapt.scale;
+   return (bytes) ? bytes : 1;
+}
+
+/**
+ * @brief Max time a document waits in a batch.
+ * @param store Store structure.
+ * @return Linger of batches, shortened so that linger and request
+ *         latency fit within the target.
+ */
+double
+store_adapt_linger(Store *store)
+{
+   double linger;
+
+   if (store->adapt.target <= 0.0)
+     return store->batch.linger;
+
+   linger = store->adapt.target - store->adapt.latency;
+   if (linger < store->adapt.target * STORE_ADAPT_MIN_LINGER)
+     linger = store->adapt.target * STORE_ADAPT_MIN_LINGER;
+   return (linger < store->batch.linger) ? linger : store->batch.linger;
+}
+
+/**
+ * @brief Number of requests that can be sent at once.
+ * @param store Store structure.
+ * @return Window of the controller, max_inflight if it is disabled.
+ */
+unsigned int
+store_adapt_inflight(Store *store)
+{
+   if (store->adapt.target <= 0.0)
+     return store->queue.max_inflight;
+
+   if (store->adapt.window > store->queue.max_inflight)
+     store->adapt.window = store->queue.max_inflight;
+   return (unsigned int)store->adapt.window;
+}
+
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Set the target latency of adaptive batching.
+ * @param store Store structure.
+ * @param target Target round-trip time of requests in seconds, 0 to
+ *        disable adaptive batching.
+ *
+ * Limits given to store_batch_set() and store_inflight_set() become
+ * ceilings. Batch limits are scaled down while requests take longer
+ * than @p target, and requests in flight are cut down while the server
+ * fails from overload, both being grown back one step at a time while
+ * requests are fast enough.<br />
+ * Batches also linger no longer than @p target minus the average
+ * latency, so that documents are delivered within about @p target
+ * when traffic is low.
+ */
+void
+store_adapt_set(Store *store,
+                double target)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   store->adapt.target = (target > 0.0) ? target : 0.0;
+   store->adapt.scale = 1.0;
+   store->adapt.window = store->queue.max_inflight;
+   store->adapt.latency = 0.0;
+   store->adapt.doc_cost = 0.0;
+   store->adapt.cut = 0.0;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,810 @@
+#include "store_private.h"
+
+/**
+ * @addtogroup Lib-Store-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+/**
+ * @brief Creates a new, empty batch.
+ * @param bulk EINA_TRUE for a _bulk batch, EINA_FALSE for a single document.
+ * @return New Store_Batch structure, NULL on failure.
+ */
+Store_Batch *
+store_batch_new(Eina_Bool bulk)
+{
+   Store_Batch *sb;
+
+   sb = calloc(1, sizeof(Store_Batch));
+   if (!sb)
+     return NULL;
+
+   sb->buf = eina_strbuf_new();
+   if (!sb->buf)
+     {
+        free(sb);
+        return NULL;
+     }
+   sb->bulk = bulk;
+   return sb;
+}
+
+/**
+ * @brief Adds room for the callbacks of one more document.
+ * @param sb Store_Batch structure.
+ * @return Store_Item to fill, NULL on failure.
+ */
+Store_Item *
+store_batch_item_add(Store_Batch *sb)
+{
+   Store_Item *si;
+
+   if (sb->count == sb->size)
+     {
+        unsigned int size = (sb->size) ? sb->size * 2 : 64;
+
+        si = realloc(sb->items, size * sizeof(Store_Item));
+        if (!si)
+          return NULL;
+        sb->items = si;
+        sb->size = size;
+     }
+
+   si = &sb->items[sb->count++];
+   memset(si, 0, sizeof(Store_Item));
+   return si;
+}
+
+/**
+ * @brief Frees a Store_Batch structure.
+ * @param sb Store_Batch structure to free.
+ */
+void
+store_batch_free(Store_Batch *sb)
+{
+   if (sb->gz) store_gz_free(sb->gz);
+   if (sb->buf) eina_strbuf_free(sb->buf);
+   free(sb->items);
+   free(sb);
+}
+
+/**
+ * @brief Reports the same error to every document of a batch.
+ * @param sb Store_Batch structure.
+ * @param store Store structure.
+ * @param errstr Error string.
+ */
+void
+store_batch_error(Store_Batch *sb,
+                  Store *store,
+                  const char *errstr)
+{
+   unsigned int i;
+
+   for (i = 0; i < sb->count; i++)
+     {
+        if (sb->items[i].error)
+          sb->items[i].error((void *)sb->items[i].data, store, (char *)errstr);
+     }
+}
+
+static const char *
+_store_batch_json_ws(const char *p,
+                     const char *end)
+{
+   while ((p < end) &&
+          ((*p == ' ') || (*p == '\n') || (*p == '\r') || (*p == '\t')))
+     p++;
+   return p;
+}
+
+/**
+ * @brief Skips a JSON value.
+ * @param p Start of value.
+ * @param end End of buffer.
+ * @return End of value, NULL if value is truncated.
+ */
+static const char *
+_store_batch_json_skip(const char *p,
+                       const char *end)
+{
+   int depth = 0;
+
+   do
+     {
+        if (p >= end)
+          return NULL;
+
+        switch (*p)
+          {
+           case '"':
+              for (p++; (p < end) && (*p != '"'); p++)
+                {
+                   if (*p == '\\')
+                     p++;
+                }
+              if (p >= end)
+                return NULL;
+              p++;
+              break;
+           case '{':
+           case '[':
+              depth++;
+              p++;
+              break;
+           case '}':
+           case ']':
+              depth--;
+              p++;
+              break;
+           default:
+              if (depth)
+                {
+                   p++;
+                   break;
+                }
+              while ((p < end) && (*p != ',') && (*p != '}') && (*p != ']') &&
+                     (*p != ' ') && (*p != '\n') && (*p != '\r') &&
+                     (*p != '\t'))
+                p++;
+              return p;
+          }
+     }
+   while (depth > 0);
+
+   return p;
+}
+
+/**
+ * @brief Finds the value of a key of a JSON object.
+ * @param p Start of object.
+ * @param end End of buffer.
+ * @param key Key to find, NULL for the first key.
+ * @return Start of value, NULL if key is not found.
+ *
+ * Values of other keys are skipped without being parsed.
+ */
+static const char *
+_store_batch_json_get(const char *p,
+                      const char *end,
+                      const char *key)
+{
+   size_t len = (key) ? strlen(key) : 0;
+   const char *k;
+   Eina_Bool match;
+
+   if (!p)
+     return NULL;
+
+   p = _store_batch_json_ws(p, end);
+   if ((p >= end) || (*p != '{'))
+     return NULL;
+   p++;
+
+   while (1)
+     {
+        p = _store_batch_json_ws(p, end);
+        if ((p >= end) || (*p != '"'))
+          return NULL;
+
+        k = p + 1;
+        p = _store_batch_json_skip(p, end);
+        if (!p)
+          return NULL;
+        match = (!key) ||
+           (((size_t)(p - 1 - k) == len) && (!memcmp(k, key, len)));
+
+        p = _store_batch_json_ws(p, end);
+        if ((p >= end) || (*p != ':'))
+          return NULL;
+        p = _store_batch_json_ws(p + 1, end);
+        if (match)
+          return p;
+
+        p = _store_batch_json_skip(p, end);
+        if (!p)
+          return NULL;
+        p = _store_batch_json_ws(p, end);
+        if ((p >= end) || (*p != ','))
+          return NULL;
+        p++;
+     }
+}
+
+/**
+ * @brief Gives one entry of a _bulk answer to the callback of its document.
+ * @param store Store structure.
+ * @param si Store_Item of the document.
+ * @param item Entry of the answer.
+ * @param item_end End of the entry.
+ * @param stored EINA_TRUE to call done callback, EINA_FALSE for error one.
+ *
+ * The entry is NUL terminated in place for the time of the callback.
+ */
+static void
+_store_batch_item_cb(Store *store,
+                     Store_Item *si,
+                     const char *item,
+                     const char *item_end,
+                     Eina_Bool stored)
+{
+   char *end = (char *)item_end,
+        c;
+
+   if ((stored) ? !si->done : !si->error)
+     return;
+
+   c = *end;
+   *end = 0;
+   if (stored)
+     si->done((void *)si->data, store, (char *)item, item_end - item);
+   else
+     si->error((void *)si->data, store, (char *)item);
+   *end = c;
+}
+
+/**
+ * @brief Copies a document to the batch of documents to try again.
+ * @param retry Batch to copy to, created if NULL.
+ * @param sb Batch of the document.
+ * @param si Store_Item of the document.
+ * @return EINA_TRUE on success, EINA_FALSE otherwise.
+ */
+static Eina_Bool
+_store_batch_requeue(Store_Batch **retry,
+                     Store_Batch *sb,
+                     Store_Item *si)
+{
+   Store_Item *ri;
+
+   if ((!*retry) && (!(*retry = store_batch_new(EINA_TRUE))))
+     return EINA_FALSE;
+
+   ri = store_batch_item_add(*retry);
+   if (!ri)
+     return EINA_FALSE;
+
+   *ri = *si;
+   ri->offset = eina_strbuf_length_get((*retry)->buf);
+   eina_strbuf_append_length((*retry)->buf,
+                             eina_strbuf_string_get(sb->buf) + si->offset,
+                             si->len);
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Dispatches an answer to the callbacks of its documents.
+ * @param store Store structure.
+ * @param sb Batch of the request.
+ * @param http_code HTTP code of the answer.
+ * @param answer Answer, NULL if sink gave none.
+ * @param len Length of @p answer.
+ *
+ * ElasticSearch answers with one entry in "items" per document, in
+ * the order they were sent. Each entry holds the status of the
+ * document and the reason why it was rejected, if it was.<br />
+ * Entries are walked in one pass over the answer, without building
+ * a tree. Documents rejected with a status worth trying again are
+ * queued again in a new batch.<br />
+ * Without answer, every document is done with an empty one.
+ */
+void
+store_batch_complete(Store *store,
+                     Store_Batch *sb,
+                     int http_code,
+                     char *answer,
+                     size_t len)
+{
+   Store_Batch *retry = NULL;
+   Store_Item *si;
+   const char *p,
+              *end,
+              *item,
+              *status;
+   unsigned int i = 0;
+   long code;
+   char *s;
+
+   if ((http_code != 200) && (http_code != 201))
+     {
+        if (sb->bulk)
+          s = store_utils_dupf("Server replied HTTP code %i to a bulk of %u "
+                               "documents\nServer replied :\n%.*s",
+                               http_code, sb->count,
+                               (int)len, (answer) ? answer : "");
+        else
+          s = store_utils_dupf("Server replied HTTP code %i\n"
+                               "Server replied :\n%.*s",
+                               http_code, (int)len, (answer) ? answer : "");
+        store_batch_error(sb, store, s);
+        free(s);
+        return;
+     }
+
+   if (!answer)
+     {
+        for (i = 0; i < sb->count; i++)
+          {
+             if (sb->items[i].done)
+               sb->items[i].done((void *)sb->items[i].data, store,
+                                 (char *)"", 0);
+          }
+        return;
+     }
+
+   p = answer;
+   end = answer + len;
+
+   if (!sb->bulk)
+     {
+        _store_batch_item_cb(store, &sb->items[0], p, end, EINA_TRUE);
+        return;
+     }
+
+   p = _store_batch_json_get(p, end, "items");
+   if ((!p) || (*p != '['))
+     {
+        ERR("sb[%p] Invalid bulk answer", sb);
+        store_batch_error(sb, store, "Invalid bulk answer");
+        return;
+     }
+
+   for (p++; i < sb->count; i++)
+     {
+        p = _store_batch_json_ws(p, end);
+        if ((p >= end) || (*p == ']'))
+          break;
+
+        /* { "index" : { "_id" : ..., "status" : 201, "error" : ... } } */
+        item = p;
+        p = _store_batch_json_skip(item, end);
+        if (!p)
+          break;
+
+        si = &sb->items[i];
+        status = _store_batch_json_get(_store_batch_json_get(item, p, NULL),
+                                       p, "status");
+        code = (status) ? strtol(status, NULL, 10) : 0;
+
+        if ((code >= 200) && (code < 300))
+          _store_batch_item_cb(store, si, item, p, EINA_TRUE);
+        else if ((code == 429) || (code >= 500))
+          {
+             if (!_store_batch_requeue(&retry, sb, si))
+               _store_batch_item_cb(store, si, item, p, EINA_FALSE);
+          }
+        else
+          _store_batch_item_cb(store, si, item, p, EINA_FALSE);
+
+        p = _store_batch_json_ws(p, end);
+        if ((p < end) && (*p == ','))
+          p++;
+     }
+
+   for (; i < sb->count; i++)
+     {
+        if (sb->items[i].error)
+          sb->items[i].error((void *)sb->items[i].data, store,
+                             (char *)"Document missing from bulk answer");
+     }
+
+   if (!retry)
+     return;
+
+   if (!retry->count)
+     {
+        store_batch_free(retry);
+        return;
+     }
+
+   DBG("sb[%p] Trying %u rejected documents again", sb, retry->count);
+   retry->attempts = sb->attempts;
+   retry->priority = sb->priority;
+   store->queue.bytes += eina_strbuf_length_get(retry->buf);
+   store_batch_retry(store, retry, http_code);
+}
+
+/**
+ * @brief Sends a batch again later, after a failed attempt.
+ * @param store Store structure.
+ * @param sb Batch that failed, its bytes counted in the queue.
+ * @param http_code HTTP code of the failed attempt, 0 if there was none.
+ *
+ * The batch waits in the retry list of the queue for a jittered
+ * exponential delay, unless the sink can fail it over to another
+ * endpoint right away. Batches of the priority lane wait in a list of
+ * their own. Once out of attempts, it goes to the spool if any, and its
+ * documents get an error otherwise.
+ */
+void
+store_batch_retry(Store *store,
+                  Store_Batch *sb,
+                  int http_code)
+{
+   Eina_List **list = (sb->priority) ?
+      &store->priority.retry : &store->queue.retry,
+             *l;
+   Store_Batch *sb2;
+   char *s;
+
+   if (++sb->attempts < store->retry.attempts)
+     {
+        sb->retry = ecore_time_get();
+
+        /* Failing over to a healthy endpoint does not need to wait */
+        if (!sb->failover)
+          sb->retry += store_utils_backoff(store->retry.delay,
+                                           store->retry.max_delay,
+                                           sb->attempts);
+        sb->failover = EINA_FALSE;
+
+        EINA_LIST_FOREACH(*list, l, sb2)
+          {
+             if (sb2->retry > sb->retry)
+               break;
+          }
+        if (l)
+          *list = eina_list_prepend_relative_list(*list, sb, l);
+        else
+          *list = eina_list_append(*list, sb);
+        if (sb->priority)
+          store->priority.pending_count++;
+        else
+          store->queue.pending_count++;
+
+        DBG("store[%p] sb[%p] Attempt %u failed, trying again in %.2fs",
+            store, sb, sb->attempts, sb->retry - ecore_time_get());
+        return;
+     }
+
+   store->queue.bytes -= eina_strbuf_length_get(sb->buf);
+   if ((store->spool) && (store_spool_write(store->spool, sb)))
+     DBG("store[%p] sb[%p] Spooled after %u attempts",
+         store, sb, sb->attempts);
+   else
+     {
+        s = store_utils_dupf("Server replied HTTP code %i, giving up after "
+                             "%u attempts", http_code, sb->attempts);
+        store_batch_error(sb, store, (s) ? s : "Failed to send request");
+        free(s);
+     }
+
+   if (sb->segment)
+     store_spool_release(store->spool, sb->segment);
+   store_batch_free(sb);
+}
+
+/**
+ * @brief Queues the batch being filled in a lane.
+ * @param store Store structure.
+ * @param priority EINA_TRUE for the priority lane.
+ */
+static void
+_store_batch_lane_flush(Store *store,
+                        Eina_Bool priority)
+{
+   Store_Batch **current = (priority) ?
+      &store->priority.current : &store->batch.current;
+   Ecore_Timer **timer = (priority) ?
+      &store->priority.timer : &store->batch.timer;
+   Store_Batch *sb;
+
+   if (*timer)
+     {
+        ecore_timer_del(*timer);
+        *timer = NULL;
+     }
+
+   sb = *current;
+   if (!sb)
+     return;
+   *current = NULL;
+
+   DBG("store[%p] sb[%p] Queuing %u %sdocuments, %zu bytes",
+       store, sb, sb->count, (priority) ? "priority " : "",
+       eina_strbuf_length_get(sb->buf));
+   store_queue_push(store, sb);
+}
+
+static Eina_Bool
+_store_batch_linger(void *data)
+{
+   Store *store = data;
+
+   store->batch.timer = NULL;
+   _store_batch_lane_flush(store, EINA_FALSE);
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_store_batch_priority_linger(void *data)
+{
+   Store *store = data;
+
+   store->priority.timer = NULL;
+   _store_batch_lane_flush(store, EINA_TRUE);
+   return EINA_FALSE;
+}
+
+/**
+ * @brief Appends a document to the batch being filled in a lane.
+ * @param store Store structure.
+ * @param priority EINA_TRUE for the priority lane.
+ * @return EINA_TRUE if document is queued, EINA_FALSE otherwise.
+ *
+ * Other parameters are the ones of store_batch_index_add().
+ */
+static Eina_Bool
+_store_batch_lane_add(Store *store,
+                      Eina_Bool priority,
+                      const char *index,
+                      const char *id,
+                      const char *buf,
+                      size_t len,
+                      Store_Done_Cb done_cb,
+                      Store_Error_Cb error_cb,
+                      const void *data)
+{
+   Store_Batch **current = (priority) ?
+      &store->priority.current : &store->batch.current;
+   Store_Batch *sb;
+   Store_Item *si;
+   Eina_Bool full;
+
+   if (!*current)
+     {
+        *current = store_batch_new(EINA_TRUE);
+        if (!*current)
+          {
+             ERR("Failed to allocate Store_Batch structure");
+             return EINA_FALSE;
+          }
+        (*current)->priority = priority;
+     }
+   sb = *current;
+
+   si = store_batch_item_add(sb);
+   if (!si)
+     {
+        ERR("Failed to grow batch");
+        return EINA_FALSE;
+     }
+   si->data = data;
+   si->done = done_cb;
+   si->error = error_cb;
+   si->offset = eina_strbuf_length_get(sb->buf);
+
+   eina_strbuf_append_length(sb->buf, "{\"index\":{", 10);
+   if (index)
+     {
+        eina_strbuf_append_length(sb->buf, "\"_index\":\"", 10);
+        eina_strbuf_append(sb->buf, index);
+        eina_strbuf_append_char(sb->buf, '"');
+     }
+   if (id)
+     {
+        eina_strbuf_append_length(sb->buf, (index) ? ",\"_id\":\"" : "\"_id\":\"",
+                                  (index) ? 8 : 7);
+        eina_strbuf_append(sb->buf, id);
+        eina_strbuf_append_char(sb->buf, '"');
+     }
+   eina_strbuf_append_length(sb->buf, "}}\n", 3);
+   eina_strbuf_append_length(sb->buf, buf, len);
+   eina_strbuf_append_char(sb->buf, '\n');
+   si->len = eina_strbuf_length_get(sb->buf) - si->offset;
+
+   if (priority)
+     full = (sb->count >= store->priority.max_docs) ||
+            (eina_strbuf_length_get(sb->buf) >= store->batch.max_bytes);
+   else
+     full = (sb->count >= store_adapt_docs(store)) ||
+            (eina_strbuf_length_get(sb->buf) >= store_adapt_bytes(store));
+   if (full)
+     {
+        sb->full = EINA_TRUE;
+        _store_batch_lane_flush(store, priority);
+        return EINA_TRUE;
+     }
+
+   if (priority)
+     {
+        if (!store->priority.timer)
+          store->priority.timer = ecore_timer_add(store->priority.linger,
+                                                  _store_batch_priority_linger,
+                                                  store);
+     }
+   else
+     {
+        if (!store->batch.timer)
+          store->batch.timer = ecore_timer_add(store_adapt_linger(store),
+                                               _store_batch_linger, store);
+        store_gz_feed(store, sb);
+     }
+   store_throttle_check(store);
+   return EINA_TRUE;
+}
+
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Set when batches of store_batch_add() are sent.
+ * @param store Store structure.
+ * @param max_docs Max number of documents in a batch, 0 for default.
+ * @param max_bytes Max size of a batch body, 0 for default.
+ * @param linger Max time a document waits in a batch, 0 for default.
+ *
+ * A batch is sent as soon as one of the limits is reached.
+ */
+void
+store_batch_set(Store *store,
+                unsigned int max_docs,
+                size_t max_bytes,
+                double linger)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   store->batch.max_docs = (max_docs) ? max_docs : STORE_BATCH_MAX_DOCS;
+   store->batch.max_bytes = (max_bytes) ? max_bytes : STORE_BATCH_MAX_BYTES;
+   store->batch.linger = (linger > 0.0) ? linger : STORE_BATCH_LINGER;
+}
+
+/**
+ * @brief Queue a document to be stored with the next _bulk request.
+ * @param store Store structure.
+ * @param buf JSON document, without newlines.
+ * @param len Length of @p buf.
+ * @param done_cb Callback to call when document is stored.
+ * @param error_cb Callback to call if document is rejected.
+ * @param data Data to pass to callbacks.
+ * @return EINA_TRUE if document is queued, EINA_FALSE otherwise.
+ *
+ * Callbacks are called once per document, with the entry of the
+ * document in the _bulk answer.
+ */
+Eina_Bool
+store_batch_add(Store *store,
+                const char *buf,
+                size_t len,
+                Store_Done_Cb done_cb,
+                Store_Error_Cb error_cb,
+                const void *data)
+{
+   return store_batch_index_add(store, NULL, NULL, buf, len,
+                                done_cb, error_cb, data);
+}
+
+/**
+ * @brief Queue a document to be stored in a given index, with a given id.
+ * @param store Store structure.
+ * @param index Name of the index, NULL for the index of the store URL.
+ * @param id Id of the document, NULL to let the server pick one.
+ * @param buf JSON document, without newlines.
+ * @param len Length of @p buf.
+ * @param done_cb Callback to call when document is stored.
+ * @param error_cb Callback to call if document is rejected.
+ * @param data Data to pass to callbacks.
+ * @return EINA_TRUE if document is queued, EINA_FALSE otherwise.
+ *
+ * Documents of all indexes share the same _bulk requests, so routing
+ * documents to many indexes does not make requests smaller.<br />
+ * A document sent again with the same id replaces the stored one, so
+ * retries and replays of the spool do not duplicate documents.<br />
+ * @p index and @p id are written as is in the action line of the
+ * document, and must not hold quotes or backslashes.
+ */
+Eina_Bool
+store_batch_index_add(Store *store,
+                      const char *index,
+                      const char *id,
+                      const char *buf,
+                      size_t len,
+                      Store_Done_Cb done_cb,
+                      Store_Error_Cb error_cb,
+                      const void *data)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(store, EINA_FALSE);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(buf, EINA_FALSE);
+
+   return _store_batch_lane_add(store, EINA_FALSE, index, id, buf, len,
+                                done_cb, error_cb, data);
+}
+
+/**
+ * @brief Queue a document to be stored ahead of other documents.
+ * @param store Store structure.
+ * @param index Name of the index, NULL for the index of the store URL.
+ * @param id Id of the document, NULL to let the server pick one.
+ * @param buf JSON document, without newlines.
+ * @param len Length of @p buf.
+ * @param done_cb Callback to call when document is stored.
+ * @param error_cb Callback to call if document is rejected.
+ * @param data Data to pass to callbacks.
+ * @return EINA_TRUE if document is queued, EINA_FALSE otherwise.
+ *
+ * Works like store_batch_index_add(), with batches of the priority lane,
+ * see store_priority_set().
+ */
+Eina_Bool
+store_batch_priority_add(Store *store,
+                         const char *index,
+                         const char *id,
+                         const char *buf,
+                         size_t len,
+                         Store_Done_Cb done_cb,
+                         Store_Error_Cb error_cb,
+                         const void *data)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(store, EINA_FALSE);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(buf, EINA_FALSE);
+
+   return _store_batch_lane_add(store, EINA_TRUE, index, id, buf, len,
+                                done_cb, error_cb, data);
+}
+
+/**
+ * @brief Send the batches being filled, if any.
+ * @param store Store structure.
+ */
+void
+store_batch_flush(Store *store)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   _store_batch_lane_flush(store, EINA_TRUE);
+   _store_batch_lane_flush(store, EINA_FALSE);
+}
+
+/**
+ * @brief Get the body of a request given to a sink.
+ * @param req Store_Request structure.
+ * @param len Set to the length of the body, can be NULL.
+ * @return NDJSON body of a _bulk request, or a single JSON document.
+ *
+ * In a _bulk body, each document is preceded by its action line.
+ */
+const char *
+store_request_body_get(Store_Request *req,
+                       size_t *len)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(req, NULL);
+
+   if (len)
+     *len = eina_strbuf_length_get(req->buf);
+   return eina_strbuf_string_get(req->buf);
+}
+
+/**
+ * @brief Get the number of documents of a request given to a sink.
+ * @param req Store_Request structure.
+ * @return Number of documents.
+ */
+unsigned int
+store_request_count_get(Store_Request *req)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(req, 0);
+
+   return req->count;
+}
+
+/**
+ * @brief Tell if a request given to a sink is a _bulk request.
+ * @param req Store_Request structure.
+ * @return EINA_TRUE for a _bulk request, EINA_FALSE for a single document.
+ */
+Eina_Bool
+store_request_bulk_get(Store_Request *req)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(req, EINA_FALSE);
+
+   return req->bulk;
+}
+
+/**
+ * @}
+ */
@@ -9,9 +9,24 @@
  * @cond IGNORE
  */
 
+/**
+ * @brief Finds the request an url event belongs to.
+ * @param ec Ecore_Con_Url of the event.
+ * @return Store_Add structure, NULL if url is not one of ours.
+ */
+static Store_Add *
+_store_event_request_get(Ecore_Con_Url *ec)
+{
+   Store_Add *sa = ecore_con_url_data_get(ec);
+
+   if ((!sa) || (sa->magic != STORE_ADD_MAGIC) || (sa->ec != ec))
+     return NULL;
+   return sa;
+}
+
 /**
  * @brief Store received data from ElasticSearch server.
- * @param data Store_Add structure.
+ * @param data UNUSED.
  * @param type UNUSED.
  * @param event_info Ecore_Con_Event_Url_Data structure.
  * @return EINA_TRUE.
@@ -20,14 +35,15 @@
  * received from web server.
  */
 Eina_Bool
-store_event_data(void *data,
+store_event_data(void *data EINA_UNUSED,
                  int type EINA_UNUSED,
                  void *event_info)
 {
-   Store_Add *sa = data;
    Ecore_Con_Event_Url_Data *url_data = event_info;
+   Store_Add *sa;
 
-   if ((sa != ecore_con_url_data_get(url_data->url_con)) || (!sa))
+   sa = _store_event_request_get(url_data->url_con);
+   if (!sa)
      return EINA_TRUE;
 
    DBG("sa[%p] url_data[%p] data_len=%i", sa, url_data, url_data->size);
@@ -40,47 +56,26 @@ store_event_data(void *data,
 
 /**
  * @brief Storing is over and we got total answer.
- * @param data Store_Add structure.
+ * @param data UNUSED.
  * @param type UNUSED.
  * @param event_info Ecore_Con_Event_Url_Complete.
  */
 Eina_Bool
-store_event_complete(void *data,
+store_event_complete(void *data EINA_UNUSED,
                      int type EINA_UNUSED,
                      void *event_info)
 {
-   Store_Add *sa = data;
    Ecore_Con_Event_Url_Complete *url_complete = event_info;
-   char *errstr;
+   Store_Add *sa;
    int http_code;
 
-   DBG("sa[%p] url_complete[%p] data_get[%p]",
-       sa, url_complete, ecore_con_url_data_get(url_complete->url_con));
-
-   if ((sa != ecore_con_url_data_get(url_complete->url_con)) || (!sa))
+   sa = _store_event_request_get(url_complete->url_con);
+   DBG("sa[%p] url_complete[%p]", sa, url_complete);
+   if ((!sa) || (!sa->batch))
      return EINA_TRUE;
 
    http_code = ecore_con_url_status_code_get(sa->ec);
-   if ((http_code != 200) && (http_code != 201))
-     {
-        errstr = store_utils_dupf("Server replied HTTP code %i\n"
-                                  "Data sent :\n%s\n"
-                                  "Server replied :\n%s",
-                                  http_code,
-                                  sa->data.sent,
-                                  eina_strbuf_string_get(sa->data.buf));
-        sa->cb.error((void *)sa->cb.data, sa->store, errstr);
-        free(errstr);
-        goto complete_end;
-     }
-
-   sa->cb.done((void *)sa->cb.data,
-               sa->store,
-               (char *)eina_strbuf_string_get(sa->data.buf),
-               eina_strbuf_length_get(sa->data.buf));
-
-complete_end:
-   store_add_free(sa);
+   store_http_done(sa, http_code);
    return EINA_TRUE;
 }
 
@@ -0,0 +1,386 @@
+#include "store_private.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @addtogroup Lib-Store-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+static Eina_Bool
+_store_file_sync(void *data)
+{
+   Store_File *sf = data;
+
+   sf->sync = NULL;
+   if ((sf->fd >= 0) && (fdatasync(sf->fd)))
+     ERR("Failed to sync %s : %s", sf->path, strerror(errno));
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_store_file_open(Store_File *sf)
+{
+   struct stat st;
+
+   sf->fd = open(sf->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+   if (sf->fd < 0)
+     {
+        ERR("Failed to open %s : %s", sf->path, strerror(errno));
+        return EINA_FALSE;
+     }
+
+   sf->size = (fstat(sf->fd, &st)) ? 0 : (size_t)st.st_size;
+   sf->opened = ecore_time_get();
+   DBG("Opened %s, %zu bytes", sf->path, sf->size);
+   return EINA_TRUE;
+}
+
+static void
+_store_file_close(Store_File *sf)
+{
+   if (sf->sync)
+     {
+        ecore_timer_del(sf->sync);
+        _store_file_sync(sf);
+     }
+   close(sf->fd);
+   sf->fd = -1;
+}
+
+/**
+ * @brief Renames the current file, next write creates a new one.
+ * @param sf Store_File structure.
+ *
+ * Rotated files are named after the path, the local time of rotation
+ * and a sequence number, like path.20261019-072617.3.
+ */
+static void
+_store_file_rotate(Store_File *sf)
+{
+   char ts[32],
+        *to;
+   time_t t = time(NULL);
+   struct tm tm;
+
+   _store_file_close(sf);
+
+   localtime_r(&t, &tm);
+   strftime(ts, sizeof(ts), "%Y%m%d-%H%M%S", &tm);
+   to = store_utils_dupf("%s.%s.%u", sf->path, ts, sf->seq++);
+   if (!to)
+     return;
+
+   if (rename(sf->path, to))
+     ERR("Failed to rename %s to %s : %s", sf->path, to, strerror(errno));
+   else
+     NFO("Rotated %s to %s", sf->path, to);
+   free(to);
+}
+
+/**
+ * @brief Writes a vector, looping over partial writes.
+ * @param fd File descriptor.
+ * @param iov Vector, modified in place.
+ * @param count Number of entries of @p iov.
+ * @return EINA_TRUE if every byte is written, EINA_FALSE otherwise.
+ */
+static Eina_Bool
+_store_file_writev(int fd,
+                   struct iovec *iov,
+                   int count)
+{
+   ssize_t r;
+
+   while (count)
+     {
+        r = writev(fd, iov, count);
+        if (r < 0)
+          {
+             if (errno == EINTR)
+               continue;
+             return EINA_FALSE;
+          }
+
+        while ((count) && ((size_t)r >= iov->iov_len))
+          {
+             r -= iov->iov_len;
+             iov++;
+             count--;
+          }
+        if (count)
+          {
+             iov->iov_base = (char *)iov->iov_base + r;
+             iov->iov_len -= r;
+          }
+     }
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Writes the documents of a batch as NDJSON lines.
+ * @param sf Store_File structure.
+ * @param sb Batch to write.
+ * @param written Set to the number of bytes written.
+ * @return EINA_TRUE on success, EINA_FALSE otherwise.
+ *
+ * Action lines of a _bulk body are left out, each document line going
+ * straight from the body to the file, STORE_FILE_IOV lines per call.
+ */
+static Eina_Bool
+_store_file_write(Store_File *sf,
+                  Store_Batch *sb,
+                  size_t *written)
+{
+   struct iovec iov[STORE_FILE_IOV];
+   const char *body = eina_strbuf_string_get(sb->buf),
+              *doc,
+              *nl;
+   unsigned int i;
+   int n = 0;
+   size_t len;
+
+   *written = 0;
+   for (i = 0; i < sb->count; i++)
+     {
+        doc = body + sb->items[i].offset;
+        len = sb->items[i].len;
+        if (sb->bulk)
+          {
+             nl = memchr(doc, '\n', len);
+             if (nl)
+               {
+                  len -= nl + 1 - doc;
+                  doc = nl + 1;
+               }
+          }
+
+        iov[n].iov_base = (void *)doc;
+        iov[n++].iov_len = len;
+        *written += len;
+        if (!sb->bulk)
+          {
+             iov[n].iov_base = (void *)"\n";
+             iov[n++].iov_len = 1;
+             *written += 1;
+          }
+
+        if ((n + 2 > (int)(sizeof(iov) / sizeof(iov[0]))) ||
+            (i + 1 == sb->count))
+          {
+             if (!_store_file_writev(sf->fd, iov, n))
+               return EINA_FALSE;
+             n = 0;
+          }
+     }
+   return EINA_TRUE;
+}
+
+static void *
+_store_file_new(Store *store,
+                const char *path)
+{
+   Store_File *sf;
+
+   sf = calloc(1, sizeof(Store_File));
+   if (!sf)
+     {
+        ERR("Failed to allocate Store_File structure");
+        return NULL;
+     }
+   sf->store = store;
+   sf->fd = -1;
+   sf->max_bytes = STORE_FILE_MAX_BYTES;
+   sf->max_age = STORE_FILE_MAX_AGE;
+   sf->sync_interval = STORE_FILE_SYNC;
+
+   if (!path)
+     {
+        sf->fd = STDOUT_FILENO;
+        return sf;
+     }
+
+   sf->path = eina_stringshare_add(path);
+   if ((!sf->path) || (!_store_file_open(sf)))
+     {
+        eina_stringshare_del(sf->path);
+        free(sf);
+        return NULL;
+     }
+   return sf;
+}
+
+static void *
+_store_file_sink_open(Store *store,
+                      const char *target)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(target, NULL);
+
+   return _store_file_new(store, target);
+}
+
+static void *
+_store_file_stdout_open(Store *store,
+                        const char *target EINA_UNUSED)
+{
+   return _store_file_new(store, NULL);
+}
+
+static void
+_store_file_sink_close(void *data)
+{
+   Store_File *sf = data;
+
+   if ((sf->path) && (sf->fd >= 0))
+     _store_file_close(sf);
+   eina_stringshare_del(sf->path);
+   free(sf);
+}
+
+/**
+ * @brief Tells if the file can take a request.
+ * @param data Store_File structure.
+ * @param req UNUSED.
+ * @param when Set to when the file can be written again after a failure.
+ * @return STORE_SINK_DOWN while waiting after a failure.
+ */
+static Store_Sink_State
+_store_file_state(void *data,
+                  Store_Request *req EINA_UNUSED,
+                  double *when)
+{
+   Store_File *sf = data;
+
+   if ((sf->failures) && (ecore_time_get() < sf->retry))
+     {
+        *when = sf->retry;
+        return STORE_SINK_DOWN;
+     }
+   return STORE_SINK_READY;
+}
+
+/**
+ * @brief Writes a batch, and ends its request right away.
+ * @param data Store_File structure.
+ * @param sb Batch to write.
+ * @return EINA_TRUE.
+ *
+ * Writes block the main loop, so that a slow disk or reader of stdout
+ * slows down the app like a slow server would. A failed write ends the
+ * request with status 0, and the batch is written again later.
+ */
+static Eina_Bool
+_store_file_send(void *data,
+                 Store_Request *sb)
+{
+   Store_File *sf = data;
+   Store *store = sf->store;
+   size_t written;
+
+   if ((sf->path) && (sf->fd >= 0) && (sf->size) &&
+       (((sf->max_bytes) &&
+         (sf->size + eina_strbuf_length_get(sb->buf) > sf->max_bytes)) ||
+        ((sf->max_age > 0.0) &&
+         (ecore_time_get() - sf->opened >= sf->max_age))))
+     _store_file_rotate(sf);
+
+   if (((sf->fd < 0) && (!_store_file_open(sf))) ||
+       (!_store_file_write(sf, sb, &written)))
+     {
+        if (sf->fd >= 0)
+          {
+             ERR("Failed to write to %s : %s",
+                 (sf->path) ? sf->path : "stdout", strerror(errno));
+             /* Drop the lines written so far, the batch is written again */
+             if ((sf->path) && (ftruncate(sf->fd, sf->size)))
+               ERR("Failed to truncate %s : %s", sf->path, strerror(errno));
+          }
+        store_rate_sent(store, NULL, sb, 0);
+        sf->failures++;
+        sf->retry = ecore_time_get() +
+           store_utils_backoff(store->retry.delay, store->retry.max_delay,
+                               sf->failures);
+        store_request_done(store, sb, 0, NULL, 0);
+        return EINA_TRUE;
+     }
+
+   DBG("store[%p] Wrote %u documents, %zu bytes", store, sb->count, written);
+   store_rate_sent(store, NULL, sb, written);
+   sf->failures = 0;
+   sf->size += written;
+   if ((sf->path) && (!sf->sync))
+     sf->sync = ecore_timer_add(sf->sync_interval, _store_file_sync, sf);
+
+   store_request_done(store, sb, 200, NULL, 0);
+   return EINA_TRUE;
+}
+
+/**
+ * @endcond
+ */
+
+const Store_Sink_Class store_sink_file =
+{
+   "file",
+   _store_file_sink_open,
+   _store_file_sink_close,
+   _store_file_state,
+   _store_file_send
+};
+
+const Store_Sink_Class store_sink_stdout =
+{
+   "stdout",
+   _store_file_stdout_open,
+   _store_file_sink_close,
+   _store_file_state,
+   _store_file_send
+};
+
+/**
+ * @brief Set how the file of a file sink is synced and rotated.
+ * @param store Store structure, created with store_sink_file.
+ * @param max_bytes Rotate the file before it grows above that size,
+ *        0 for default.
+ * @param max_age Rotate the file once it is that old, 0 for default,
+ *        negative to never rotate on age.
+ * @param sync_interval Max delay before written documents are synced
+ *        to disk, 0 for default.
+ *
+ * Rotated files are renamed to the path followed by the time of
+ * rotation, and a new file is created.
+ */
+void
+store_file_set(Store *store,
+               size_t max_bytes,
+               double max_age,
+               double sync_interval)
+{
+   Store_File *sf;
+
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   if (store->sink.cls != &store_sink_file)
+     {
+        ERR("store[%p] Not a file sink", store);
+        return;
+     }
+   sf = store->sink.data;
+
+   sf->max_bytes = (max_bytes) ? max_bytes : STORE_FILE_MAX_BYTES;
+   sf->max_age = (max_age != 0.0) ? max_age : STORE_FILE_MAX_AGE;
+   sf->sync_interval = (sync_interval > 0.0) ? sync_interval : STORE_FILE_SYNC;
+}
+
+/**
+ * @}
+ */
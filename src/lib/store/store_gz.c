@@ -0,0 +1,309 @@
+#include "store_private.h"
+
+/**
+ * @addtogroup Lib-Store-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+static Eina_Bool _store_gz_run(Store_Gz *gz, Eina_Bool finish);
+
+/**
+ * @brief Deflates the chunk of a batch, from a worker thread.
+ * @param data Store_Gz structure.
+ * @param thread UNUSED.
+ */
+static void
+_store_gz_job(void *data,
+              Ecore_Thread *thread EINA_UNUSED)
+{
+   Store_Gz *gz = data;
+   unsigned char out[16 * 1024];
+   int r;
+
+   gz->z.next_in = (unsigned char *)gz->chunk.s;
+   gz->z.avail_in = gz->chunk.len;
+
+   do
+     {
+        gz->z.next_out = out;
+        gz->z.avail_out = sizeof(out);
+        r = deflate(&gz->z, (gz->chunk.finish) ? Z_FINISH : Z_NO_FLUSH);
+        if (r == Z_STREAM_ERROR)
+          {
+             gz->error = EINA_TRUE;
+             return;
+          }
+        eina_binbuf_append_length(gz->buf, out, sizeof(out) - gz->z.avail_out);
+     }
+   while ((r != Z_STREAM_END) &&
+          ((gz->chunk.finish) || (!gz->z.avail_out)));
+}
+
+/**
+ * @brief Starts the next job of a batch, or sends it once compressed.
+ * @param gz Store_Gz structure, without running job.
+ *
+ * While the batch is being filled, a job starts once STORE_GZ_CHUNK
+ * bytes were appended since the last one. Once a sink waits for the
+ * batch, the last job deflates what is left and ends the stream.
+ */
+static void
+_store_gz_next(Store_Gz *gz)
+{
+   Store_Gz_Ready_Cb cb = gz->ready.cb;
+   Store_Batch *sb = gz->sb;
+
+   if (!cb)
+     {
+        if ((!gz->error) &&
+            (eina_strbuf_length_get(sb->buf) - gz->in >= STORE_GZ_CHUNK))
+          _store_gz_run(gz, EINA_FALSE);
+        return;
+     }
+
+   if ((!gz->done) && (!gz->error) && (_store_gz_run(gz, EINA_TRUE)))
+     return;
+
+   gz->ready.cb = NULL;
+   if (gz->error)
+     WRN("sb[%p] Failed to compress batch, sending it as is", sb);
+
+   cb(gz->ready.data);
+}
+
+/**
+ * @brief Gets a finished job back in the main loop.
+ * @param data Store_Gz structure.
+ * @param thread UNUSED.
+ */
+static void
+_store_gz_end(void *data,
+              Ecore_Thread *thread EINA_UNUSED)
+{
+   Store_Gz *gz = data;
+
+   gz->running = EINA_FALSE;
+   gz->ended = gz->jobs;
+   free(gz->chunk.s);
+   gz->chunk.s = NULL;
+
+   if (!gz->sb)
+     {
+        store_gz_free(gz);
+        return;
+     }
+
+   if ((gz->chunk.finish) && (!gz->error))
+     gz->done = EINA_TRUE;
+   _store_gz_next(gz);
+}
+
+static void
+_store_gz_cancel(void *data,
+                 Ecore_Thread *thread)
+{
+   Store_Gz *gz = data;
+
+   gz->error = EINA_TRUE;
+   _store_gz_end(data, thread);
+}
+
+/**
+ * @brief Gives the raw bytes appended since last job to a new job.
+ * @param gz Store_Gz structure, without running job.
+ * @param finish EINA_TRUE to end the gzip stream.
+ * @return EINA_TRUE if job is started, EINA_FALSE otherwise.
+ */
+static Eina_Bool
+_store_gz_run(Store_Gz *gz,
+              Eina_Bool finish)
+{
+   Store_Batch *sb = gz->sb;
+   size_t len = eina_strbuf_length_get(sb->buf) - gz->in;
+   unsigned int job;
+
+   gz->chunk.s = malloc((len) ? len : 1);
+   if (!gz->chunk.s)
+     {
+        gz->error = EINA_TRUE;
+        return EINA_FALSE;
+     }
+   memcpy(gz->chunk.s, eina_strbuf_string_get(sb->buf) + gz->in, len);
+   gz->chunk.len = len;
+   gz->chunk.finish = finish;
+   gz->in += len;
+
+   /* Without thread, ecore runs the job and its callbacks right away */
+   gz->running = EINA_TRUE;
+   job = ++gz->jobs;
+   if ((!ecore_thread_run(_store_gz_job, _store_gz_end,
+                          _store_gz_cancel, gz)) && (gz->ended < job))
+     {
+        ERR("Failed to create compression thread");
+        gz->running = EINA_FALSE;
+        free(gz->chunk.s);
+        gz->chunk.s = NULL;
+        gz->error = EINA_TRUE;
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Starts compressing the body of a batch.
+ * @param store Store structure.
+ * @param sb Batch to compress.
+ * @return New Store_Gz structure, NULL on failure.
+ */
+static Store_Gz *
+_store_gz_new(Store *store,
+              Store_Batch *sb)
+{
+   Store_Gz *gz;
+
+   gz = calloc(1, sizeof(Store_Gz));
+   if (!gz)
+     return NULL;
+
+   gz->buf = eina_binbuf_new();
+   if (!gz->buf)
+     goto gz_free;
+
+   /* 16 + 15 bits window : gzip header instead of zlib one */
+   if (deflateInit2(&gz->z, store->compress.level, Z_DEFLATED, 16 + 15, 8,
+                    Z_DEFAULT_STRATEGY) != Z_OK)
+     {
+        ERR("Failed to initialize deflate stream");
+        eina_binbuf_free(gz->buf);
+        goto gz_free;
+     }
+
+   gz->sb = sb;
+   sb->gz = gz;
+   return gz;
+
+gz_free:
+   free(gz);
+   return NULL;
+}
+
+/**
+ * @brief Compresses what was appended to a batch being filled.
+ * @param store Store structure.
+ * @param sb Batch being filled.
+ *
+ * Compression overlaps with the filling of the batch, so that little
+ * is left to compress when it is sent.
+ */
+void
+store_gz_feed(Store *store,
+              Store_Batch *sb)
+{
+   if ((store->compress.type == STORE_COMPRESS_NONE) ||
+       (eina_strbuf_length_get(sb->buf) < STORE_GZ_CHUNK))
+     return;
+
+   if ((!sb->gz) && (!_store_gz_new(store, sb)))
+     return;
+
+   if (!sb->gz->running)
+     _store_gz_next(sb->gz);
+}
+
+/**
+ * @brief Gets the body of a batch ready to be sent.
+ * @param store Store structure.
+ * @param sb Batch being sent.
+ * @param cb Function sending the batch once compressed.
+ * @param data Data of @p cb.
+ * @return EINA_TRUE if batch can be sent now, EINA_FALSE if @p cb will
+ *         send it once compressed.
+ *
+ * Small bodies are not worth a job, and are sent as is.
+ */
+Eina_Bool
+store_gz_seal(Store *store,
+              Store_Batch *sb,
+              Store_Gz_Ready_Cb cb,
+              void *data)
+{
+   Store_Gz *gz = sb->gz;
+
+   if (!gz)
+     {
+        if ((store->compress.type == STORE_COMPRESS_NONE) ||
+            (eina_strbuf_length_get(sb->buf) < STORE_GZ_MIN))
+          return EINA_TRUE;
+
+        gz = _store_gz_new(store, sb);
+        if (!gz)
+          return EINA_TRUE;
+     }
+
+   if ((gz->done) || (gz->error))
+     return EINA_TRUE;
+
+   gz->ready.cb = cb;
+   gz->ready.data = data;
+   if ((gz->running) || (_store_gz_run(gz, EINA_TRUE)))
+     return EINA_FALSE;
+
+   gz->ready.cb = NULL;
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Frees the compression of a batch.
+ * @param gz Store_Gz structure.
+ *
+ * A running job keeps the structure, which is freed once the job ends.
+ */
+void
+store_gz_free(Store_Gz *gz)
+{
+   if (gz->running)
+     {
+        gz->sb = NULL;
+        gz->ready.cb = NULL;
+        return;
+     }
+
+   deflateEnd(&gz->z);
+   eina_binbuf_free(gz->buf);
+   free(gz);
+}
+
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Set how request bodies are compressed.
+ * @param store Store structure.
+ * @param type Compression to use, STORE_COMPRESS_NONE to disable it.
+ * @param level Compression level, from 1 (fastest) to 9 (smallest),
+ *        0 for default.
+ *
+ * Bodies of _bulk batches are compressed by worker threads as documents
+ * are added, and sent with a Content-Encoding header. Bodies smaller
+ * than 1KB are sent as is.
+ */
+void
+store_compress_set(Store *store,
+                   Store_Compress type,
+                   int level)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   store->compress.type = type;
+   store->compress.level = ((level > 0) && (level <= 9)) ?
+      level : Z_DEFAULT_COMPRESSION;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,532 @@
+#include "store_private.h"
+
+/**
+ * @addtogroup Lib-Store-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+/**
+ * @brief Creates a new endpoint.
+ * @param url URL to store single documents to, _bulk is appended to it
+ *        for batches.
+ * @return New Store_Endpoint structure, NULL on failure.
+ */
+static Store_Endpoint *
+_store_http_endpoint_new(const char *url)
+{
+   Store_Endpoint *se;
+
+   se = calloc(1, sizeof(Store_Endpoint));
+   if (!se)
+     {
+        ERR("Failed to allocate Store_Endpoint structure");
+        return NULL;
+     }
+
+   se->url = eina_stringshare_add(url);
+   se->bulk_url = eina_stringshare_printf("%s%s_bulk", url,
+                                          (url[0] && url[strlen(url) - 1] == '/') ?
+                                          "" : "/");
+   if ((!se->url) || (!se->bulk_url))
+     {
+        ERR("Failed to allocate URL string");
+        eina_stringshare_del(se->url);
+        eina_stringshare_del(se->bulk_url);
+        free(se);
+        return NULL;
+     }
+   return se;
+}
+
+/**
+ * @brief Frees an endpoint and its handles.
+ * @param sh Store_Http structure.
+ * @param se Store_Endpoint structure to free.
+ *
+ * Requests still being sent are ended with status 0, so that their
+ * batches are sent again or spooled.
+ */
+static void
+_store_http_endpoint_free(Store_Http *sh,
+                          Store_Endpoint *se)
+{
+   Store_Batch *sb;
+   Store_Add *sa;
+
+   EINA_LIST_FREE(se->busy, sa)
+     {
+        sb = sa->batch;
+        sa->batch = NULL;
+        /* A running compression job must not post with this handle */
+        if (sb->gz)
+          sb->gz->ready.cb = NULL;
+        store_add_free(sa);
+        store_request_done(sh->store, sb, 0, NULL, 0);
+     }
+   EINA_LIST_FREE(se->idle, sa)
+     store_add_free(sa);
+   eina_stringshare_del(se->url);
+   eina_stringshare_del(se->bulk_url);
+   free(se);
+}
+
+/**
+ * @brief Creates a new request handle.
+ * @param store Store structure.
+ * @param se Endpoint the handle sends to.
+ * @return New Store_Add structure, NULL on failure.
+ */
+static Store_Add *
+_store_http_handle_new(Store *store,
+                       Store_Endpoint *se)
+{
+   Store_Add *sa;
+
+   sa = calloc(1, sizeof(Store_Add));
+   if (!sa)
+     {
+        ERR("Failed to allocate Store_Add structure");
+        return NULL;
+     }
+   sa->magic = STORE_ADD_MAGIC;
+   sa->store = store;
+   sa->endpoint = se;
+
+   sa->ec = ecore_con_url_new(se->url);
+   if (!sa->ec)
+     {
+        ERR("Failed to create ecore_con_url object");
+        goto sa_free;
+     }
+
+   sa->data.buf = eina_strbuf_new();
+   if (!sa->data.buf)
+     {
+        ERR("Failed to allocate storage buffer");
+        goto sa_free;
+     }
+
+   ecore_con_url_data_set(sa->ec, sa);
+   ecore_con_url_timeout_set(sa->ec, STORE_TIMEOUT);
+   return sa;
+
+sa_free:
+   store_add_free(sa);
+   return NULL;
+}
+
+/**
+ * @brief Updates the circuit breaker of an endpoint from an answer.
+ * @param store Store structure.
+ * @param se Store_Endpoint structure.
+ * @param http_code HTTP code of the answer, 0 if there was none.
+ *
+ * The breaker opens after STORE_BREAKER_FAILURES failed requests in a
+ * row. Each failed probe then doubles the time before the next one.
+ */
+static void
+_store_http_endpoint_answer(Store *store,
+                            Store_Endpoint *se,
+                            int http_code)
+{
+   if (!store_request_failed(http_code))
+     {
+        if (STORE_ENDPOINT_OPEN(se))
+          NFO("Endpoint %s is back", se->url);
+        se->failures = 0;
+        return;
+     }
+
+   se->failures++;
+   if (!STORE_ENDPOINT_OPEN(se))
+     return;
+
+   if (se->failures == STORE_BREAKER_FAILURES)
+     WRN("Endpoint %s is down (HTTP code %i)", se->url, http_code);
+   se->retry = ecore_time_get() +
+      store_utils_backoff(store->retry.delay, store->retry.max_delay,
+                          se->failures - STORE_BREAKER_FAILURES + 1);
+}
+
+/**
+ * @brief Picks the endpoint to send the next request to.
+ * @param sh Store_Http structure.
+ * @param req Request to send, NULL for any request.
+ * @param when Set to when an endpoint can take a request, if none can
+ *        right now.
+ * @param paced Set to EINA_TRUE if an endpoint waits for bandwidth.
+ * @return Store_Endpoint structure, NULL if no endpoint can take it.
+ *
+ * Endpoints with an open breaker are ejected, and only get one probe
+ * request at a time once their retry time is over. A successful probe
+ * admits them back. Probes do not take requests an idle healthy
+ * endpoint can send, and requests of the priority lane are only probes
+ * when no healthy endpoint can take them. Endpoints out of bandwidth are
+ * skipped, except for requests of the priority lane. Other endpoints are
+ * picked by least outstanding requests, the one @p req failed on coming
+ * last.
+ */
+static Store_Endpoint *
+_store_http_endpoint_pick(Store_Http *sh,
+                          Store_Request *req,
+                          double *when,
+                          Eina_Bool *paced)
+{
+   Store_Endpoint *se,
+                  *best = NULL,
+                  *probe = NULL,
+                  *avoid = (req) ? req->failed : NULL;
+   Eina_List *l;
+   double now = ecore_time_get(),
+          next = 0.0,
+          t;
+
+   if (when)
+     *when = 0.0;
+   if (paced)
+     *paced = EINA_FALSE;
+
+   EINA_LIST_FOREACH(sh->endpoints, l, se)
+     {
+        if (STORE_ENDPOINT_OPEN(se))
+          {
+             if (se->inflight)
+               continue;
+
+             if (now >= se->retry)
+               {
+                  if (!probe)
+                    probe = se;
+                  continue;
+               }
+
+             if ((when) && ((*when == 0.0) || (se->retry < *when)))
+               *when = se->retry;
+             continue;
+          }
+
+        if (((!req) || (!req->priority)) &&
+            ((t = store_rate_when(&se->rate)) > 0.0))
+          {
+             if ((next == 0.0) || (t < next))
+               next = t;
+             continue;
+          }
+
+        if ((se == avoid) && (best))
+          continue;
+
+        if ((!best) || (best == avoid) || (se->inflight < best->inflight))
+          best = se;
+     }
+
+   if ((probe) &&
+       ((!best) || ((best->inflight) && ((!req) || (!req->priority)))))
+     best = probe;
+
+   if (best)
+     {
+        if (when)
+          *when = 0.0;
+        return best;
+     }
+
+   if (next > 0.0)
+     {
+        if (paced)
+          *paced = EINA_TRUE;
+        if ((when) && ((*when == 0.0) || (next < *when)))
+          *when = next;
+     }
+   return NULL;
+}
+
+static void *
+_store_http_open(Store *store,
+                 const char *target)
+{
+   Store_Http *sh;
+   Store_Endpoint *se;
+
+   sh = calloc(1, sizeof(Store_Http));
+   if (!sh)
+     {
+        ERR("Failed to allocate Store_Http structure");
+        return NULL;
+     }
+   sh->store = store;
+
+   se = _store_http_endpoint_new(target);
+   if (!se)
+     {
+        free(sh);
+        return NULL;
+     }
+   sh->endpoints = eina_list_append(sh->endpoints, se);
+   return sh;
+}
+
+static void
+_store_http_close(void *data)
+{
+   Store_Http *sh = data;
+   Store_Endpoint *se;
+
+   EINA_LIST_FREE(sh->endpoints, se)
+     _store_http_endpoint_free(sh, se);
+   free(sh);
+}
+
+/**
+ * @brief Tells if an endpoint can take a request.
+ * @param data Store_Http structure.
+ * @param req Request to send, NULL for any request.
+ * @param when Set to when an endpoint can take a request.
+ * @return STORE_SINK_PACED if healthy endpoints wait for bandwidth until
+ *         @p when, STORE_SINK_DOWN if every breaker is open and no probe
+ *         can be sent before @p when, STORE_SINK_BUSY if a probe is
+ *         running.
+ */
+static Store_Sink_State
+_store_http_state(void *data,
+                  Store_Request *req,
+                  double *when)
+{
+   Store_Http *sh = data;
+   Eina_Bool paced;
+
+   if (_store_http_endpoint_pick(sh, req, when, &paced))
+     return STORE_SINK_READY;
+
+   if (paced)
+     return STORE_SINK_PACED;
+
+   /* Otherwise a probe is running, its answer runs the queue */
+   return (*when > 0.0) ? STORE_SINK_DOWN : STORE_SINK_BUSY;
+}
+
+/**
+ * @brief Posts the body of the batch of a busy handle.
+ * @param sa Store_Add structure.
+ * @return EINA_TRUE if request is sent, EINA_FALSE otherwise.
+ *
+ * The compressed body is sent if there is one, the raw body otherwise.
+ * On failure, the handle is freed and caller gets the batch back.
+ */
+static Eina_Bool
+_store_http_post(Store_Add *sa)
+{
+   Store_Endpoint *se = sa->endpoint;
+   Store_Batch *sb = sa->batch;
+   const void *body = eina_strbuf_string_get(sb->buf);
+   size_t len = eina_strbuf_length_get(sb->buf);
+
+   ecore_con_url_additional_headers_clear(sa->ec);
+   if ((sb->gz) && (sb->gz->done))
+     {
+        body = eina_binbuf_string_get(sb->gz->buf);
+        len = eina_binbuf_length_get(sb->gz->buf);
+        ecore_con_url_additional_header_add(sa->ec, "Content-Encoding",
+                                            "gzip");
+     }
+
+   eina_strbuf_reset(sa->data.buf);
+   if (!ecore_con_url_post(sa->ec, body, len,
+                           (sb->bulk) ? "application/x-ndjson" : "text/json"))
+     {
+        ERR("Failed to issue POST method");
+        store_rate_sent(sa->store, &se->rate, sb, 0);
+        se->inflight--;
+        se->busy = eina_list_remove(se->busy, sa);
+        sa->batch = NULL;
+        store_add_free(sa);
+        return EINA_FALSE;
+     }
+
+   DBG("store[%p] sa[%p] Sending %u documents, %zu bytes (%zu on the wire)",
+       sa->store, sa, sb->count, eina_strbuf_length_get(sb->buf), len);
+   store_rate_sent(sa->store, &se->rate, sb, len);
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Posts the batch of a busy handle once compressed.
+ * @param data Store_Add structure.
+ */
+static void
+_store_http_ready(void *data)
+{
+   Store_Add *sa = data;
+   Store_Batch *sb = sa->batch;
+
+   if (!_store_http_post(sa))
+     store_request_done(sa->store, sb, 0, NULL, 0);
+}
+
+/**
+ * @brief Sends a batch with an idle handle of the picked endpoint.
+ * @param data Store_Http structure.
+ * @param sb Batch to send.
+ * @return EINA_TRUE if request is sent, EINA_FALSE otherwise.
+ *
+ * The handle takes a slot of the endpoint right away, even when the
+ * body still has to be compressed before it is posted. The bucket of
+ * the endpoint is only charged once nothing but the post can fail, and
+ * a failed post gives the bytes back.<br />
+ * On failure, caller keeps ownership of @p sb.
+ */
+static Eina_Bool
+_store_http_send(void *data,
+                 Store_Request *sb)
+{
+   Store_Http *sh = data;
+   Store_Endpoint *se;
+   Store_Add *sa;
+
+   se = _store_http_endpoint_pick(sh, sb, NULL, NULL);
+   if (!se)
+     return EINA_FALSE;
+
+   if (se->idle)
+     {
+        sa = eina_list_data_get(se->idle);
+        se->idle = eina_list_remove_list(se->idle, se->idle);
+     }
+   else
+     {
+        sa = _store_http_handle_new(sh->store, se);
+        if (!sa)
+          return EINA_FALSE;
+     }
+
+   if (!ecore_con_url_url_set(sa->ec, (sb->bulk) ? se->bulk_url : se->url))
+     {
+        ERR("Failed to set URL");
+        store_add_free(sa);
+        return EINA_FALSE;
+     }
+
+   sa->batch = sb;
+   se->busy = eina_list_append(se->busy, sa);
+   se->inflight++;
+
+   /* From here, _store_http_post() refunds both buckets when it fails */
+   store_rate_take(&se->rate, sb->charged);
+   if (!store_gz_seal(sh->store, sb, _store_http_ready, sa))
+     return EINA_TRUE;
+   return _store_http_post(sa);
+}
+
+/**
+ * @endcond
+ */
+
+const Store_Sink_Class store_sink_http =
+{
+   "http",
+   _store_http_open,
+   _store_http_close,
+   _store_http_state,
+   _store_http_send
+};
+
+/**
+ * @cond IGNORE
+ */
+
+/**
+ * @brief Ends the request of a handle, and gives it back to its endpoint.
+ * @param sa Store_Add structure.
+ * @param http_code HTTP code of the answer, 0 if there was none.
+ *
+ * A batch failing on an endpoint is sent again right away if another
+ * endpoint is healthy. The handle is kept for the next request.
+ */
+void
+store_http_done(Store_Add *sa,
+                int http_code)
+{
+   Store *store = sa->store;
+   Store_Http *sh = store->sink.data;
+   Store_Endpoint *se = sa->endpoint,
+                  *other;
+   Store_Batch *sb = sa->batch;
+   Eina_List *l;
+
+   _store_http_endpoint_answer(store, se, http_code);
+   if (store_request_failed(http_code))
+     {
+        DBG("sa[%p] Request failed with HTTP code %i", sa, http_code);
+        sb->failed = se;
+        EINA_LIST_FOREACH(sh->endpoints, l, other)
+          {
+             if ((other != se) && (!STORE_ENDPOINT_OPEN(other)))
+               {
+                  sb->failover = EINA_TRUE;
+                  break;
+               }
+          }
+     }
+
+   sa->batch = NULL;
+   se->inflight--;
+   se->busy = eina_list_remove(se->busy, sa);
+   se->idle = eina_list_prepend(se->idle, sa);
+
+   /* Answer is only reset by the next request of the handle */
+   store_request_done(store, sb, http_code,
+                      (char *)eina_strbuf_string_get(sa->data.buf),
+                      eina_strbuf_length_get(sa->data.buf));
+}
+
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Add a server to send documents to.
+ * @param store Store structure, created by store_new().
+ * @param url URL to store single documents to, _bulk is appended to it
+ *        for batches.
+ * @return EINA_TRUE if endpoint is added, EINA_FALSE otherwise.
+ *
+ * Requests are spread over endpoints, each request going to the healthy
+ * endpoint with the fewest requests being sent. Endpoints failing
+ * several requests in a row are ejected, and admitted back once a
+ * probe request succeeds. Failed batches are sent again to another
+ * endpoint right away.
+ */
+Eina_Bool
+store_endpoint_add(Store *store,
+                   const char *url)
+{
+   Store_Http *sh;
+   Store_Endpoint *se;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(store, EINA_FALSE);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(url, EINA_FALSE);
+
+   if (store->sink.cls != &store_sink_http)
+     {
+        ERR("store[%p] Endpoints can only be added to the http sink", store);
+        return EINA_FALSE;
+     }
+   sh = store->sink.data;
+
+   se = _store_http_endpoint_new(url);
+   if (!se)
+     return EINA_FALSE;
+
+   store_rate_limit_set(&se->rate, store->rate.endpoint);
+   sh->endpoints = eina_list_append(sh->endpoints, se);
+   store_queue_run(store);
+   return EINA_TRUE;
+}
+
+/**
+ * @}
+ */
@@ -12,6 +12,10 @@
 static int _store_init_count = 0;
 int _store_log_dom_global = -1;
 
+/* Shared by all requests, events are routed with the url data */
+static Ecore_Event_Handler *_store_ev_data = NULL,
+                           *_store_ev_complete = NULL;
+
 /**
  * @brief Frees a Store_Add structure.
  * @param sa Store_Add structure to free.
@@ -21,8 +25,8 @@ store_add_free(Store_Add *sa)
 {
    if (sa->ec) ecore_con_url_free(sa->ec);
    if (sa->data.buf) eina_strbuf_free(sa->data.buf);
-   if (sa->ev.ed) ecore_event_handler_del(sa->ev.ed);
-   if (sa->ev.ec) ecore_event_handler_del(sa->ev.ec);
+   if (sa->batch) store_batch_free(sa->batch);
+   sa->magic = 0;
    free(sa);
 }
 
@@ -49,73 +53,32 @@ store_add(Store *store,
           Store_Error_Cb error_cb,
           const void *data)
 {
-   Store_Add *sa;
-   Eina_Bool r;
+   Store_Batch *sb;
+   Store_Item *si;
 
-   sa = calloc(1, sizeof(Store_Add));
-   if (!sa)
+   sb = store_batch_new(EINA_FALSE);
+   if (!sb)
      {
-        ERR("Failed to allocate Store_Add structure");
+        ERR("Failed to allocate Store_Batch structure");
         return EINA_FALSE;
      }
 
-   sa->ec = ecore_con_url_new(store->url);
-   if (!sa->ec)
-     {
-        ERR("Failed to create ecore_con_url object");
-        goto sa_free;
-     }
-
-   sa->data.buf = eina_strbuf_new();
-   if (!sa->data.buf)
+   si = store_batch_item_add(sb);
+   if (!si)
      {
-        ERR("Failed to allocate storage buffer");
-        goto sa_con_url_free;
-     }
-
-   sa->ev.ed = ecore_event_handler_add(ECORE_CON_EVENT_URL_DATA,
-                                       store_event_data, sa);
-   if (!sa->ev.ed)
-     {
-        ERR("Failed to create event handler");
-        goto sa_buf_free;
-     }
-   sa->ev.ec = ecore_event_handler_add(ECORE_CON_EVENT_URL_COMPLETE,
-                                       store_event_complete, sa);
-   if (!sa->ev.ec)
-     {
-        ERR("Failed to create event handler");
-        goto sa_event_handler_free_ed;
-     }
-
-   sa->store = store;
-   sa->cb.done = done_cb;
-   sa->cb.error = error_cb;
-   sa->cb.data = data;
-   sa->data.sent = strdup(buf);
-   DBG("store[%p] sa[%p] buf[%s]", store, sa, buf);
-   ecore_con_url_data_set(sa->ec, sa);
-   ecore_con_url_timeout_set(sa->ec, 10.0);
-   r = ecore_con_url_post(sa->ec, buf, len, "text/json");
-   if (!r)
-     {
-        ERR("Failed to issue POST method");
-        goto sa_event_handler_free_ec;
+        ERR("Failed to allocate Store_Item structure");
+        store_batch_free(sb);
+        return EINA_FALSE;
      }
-
+   si->done = done_cb;
+   si->error = error_cb;
+   si->data = data;
+   si->len = len;
+   eina_strbuf_append_length(sb->buf, buf, len);
+
+   DBG("store[%p] sb[%p] buf[%s]", store, sb, buf);
+   store_queue_push(store, sb);
    return EINA_TRUE;
-
-sa_event_handler_free_ec:
-   ecore_event_handler_del(sa->ev.ec);
-sa_event_handler_free_ed:
-   ecore_event_handler_del(sa->ev.ed);
-sa_buf_free:
-   eina_strbuf_free(sa->data.buf);
-sa_con_url_free:
-   ecore_con_url_free(sa->ec);
-sa_free:
-   free(sa);
-   return EINA_FALSE;
 }
 
 /**
@@ -147,22 +110,55 @@ store_data_get(Store *store)
  */
 Store *
 store_new(const char *url)
+{
+   return store_sink_new(&store_sink_http, url);
+}
+
+/**
+ * @brief Create a new store structure writing to a given sink.
+ * @param cls Sink class, like store_sink_http or store_sink_file.
+ * @param target Where the sink writes to, given to its open function.
+ * @return Pointer to newly created Store structure, NULL on failure.
+ *
+ * Batching, retries, spool and throttling work the same for all sinks.
+ */
+Store *
+store_sink_new(const Store_Sink_Class *cls,
+               const char *target)
 {
    Store *store;
 
+   EINA_SAFETY_ON_NULL_RETURN_VAL(cls, NULL);
+
    store = calloc(1, sizeof(Store));
    if (!store)
      {
         ERR("Failed to allocate Store object");
         return NULL;
      }
-   store->url = eina_stringshare_add(url);
-   if (!store->url)
+   store->sink.cls = cls;
+   store->sink.data = cls->open(store, target);
+   if (!store->sink.data)
      {
-        ERR("Failed to allocate URL string");
+        ERR("Failed to open %s sink", cls->name);
         goto store_free;
      }
 
+   store->batch.max_docs = STORE_BATCH_MAX_DOCS;
+   store->batch.max_bytes = STORE_BATCH_MAX_BYTES;
+   store->batch.linger = STORE_BATCH_LINGER;
+   store->queue.max_inflight = STORE_MAX_INFLIGHT;
+   store->priority.max_docs = STORE_PRIORITY_MAX_DOCS;
+   store->priority.linger = STORE_PRIORITY_LINGER;
+   store->priority.max_inflight = STORE_PRIORITY_INFLIGHT;
+   store->retry.attempts = STORE_RETRY_ATTEMPTS;
+   store->retry.delay = STORE_RETRY_DELAY;
+   store->retry.max_delay = STORE_RETRY_MAX_DELAY;
+   store->compress.level = Z_DEFAULT_COMPRESSION;
+   store->throttle.high_bytes = STORE_HIGH_BYTES;
+   store->throttle.low_bytes = STORE_LOW_BYTES;
+   store->throttle.high_batches = STORE_HIGH_BATCHES;
+   store->throttle.low_batches = STORE_LOW_BATCHES;
    return store;
 
 store_free:
@@ -173,13 +169,42 @@ store_free:
 /**
  * @brief Frees an allocated Store structure.
  * @param store Store structure to free.
+ *
+ * Lingering batches are flushed and requests being sent are stopped.
+ * Batches not sent yet are written to the spool, or fail if there is
+ * none, so apps call it before store_shutdown() when they quit.
  */
 void
 store_free(Store *store)
 {
+   Store_Batch *sb;
+
    EINA_SAFETY_ON_NULL_RETURN(store);
 
-   eina_stringshare_replace(&store->url, NULL);
+   store_batch_flush(store);
+
+   /* Requests being sent end in the retry lists */
+   store->queue.stopped = EINA_TRUE;
+   store->sink.cls->close(store->sink.data);
+   store->queue.pending = eina_list_merge(store->queue.retry,
+                                          store->queue.pending);
+   store->queue.pending = eina_list_merge(store->priority.pending,
+                                          store->queue.pending);
+   store->queue.pending = eina_list_merge(store->priority.retry,
+                                          store->queue.pending);
+   store->queue.retry = NULL;
+   store->priority.pending = NULL;
+   store->priority.retry = NULL;
+   EINA_LIST_FREE(store->queue.pending, sb)
+     {
+        /* Replayed batches are still in their segment */
+        if ((!sb->segment) &&
+            (!((store->spool) && (store_spool_write(store->spool, sb)))))
+          store_batch_error(sb, store, "Store freed before sending data");
+        store_batch_free(sb);
+     }
+   if (store->queue.timer) ecore_timer_del(store->queue.timer);
+   if (store->spool) store_spool_free(store->spool);
    free(store);
 }
 
@@ -227,8 +252,23 @@ store_init(void)
    if (!ecore_con_url_pipeline_get())
      ecore_con_url_pipeline_set(EINA_TRUE);
 
+   _store_ev_data = ecore_event_handler_add(ECORE_CON_EVENT_URL_DATA,
+                                            store_event_data, NULL);
+   _store_ev_complete = ecore_event_handler_add(ECORE_CON_EVENT_URL_COMPLETE,
+                                                store_event_complete, NULL);
+   if ((!_store_ev_data) || (!_store_ev_complete))
+     {
+        ERR("Failed to create event handlers");
+        goto del_event_handlers;
+     }
+
    return _store_init_count;
 
+del_event_handlers:
+   if (_store_ev_data) ecore_event_handler_del(_store_ev_data);
+   if (_store_ev_complete) ecore_event_handler_del(_store_ev_complete);
+   _store_ev_data = _store_ev_complete = NULL;
+   ecore_con_url_shutdown();
 shutdown_ecore_con:
    ecore_con_shutdown();
 shutdown_ecore:
@@ -259,6 +299,9 @@ store_shutdown(void)
    if (--_store_init_count != 0)
      return _store_init_count;
 
+   ecore_event_handler_del(_store_ev_data);
+   ecore_event_handler_del(_store_ev_complete);
+   _store_ev_data = _store_ev_complete = NULL;
    ecore_con_url_shutdown();
    ecore_con_shutdown();
    ecore_shutdown();
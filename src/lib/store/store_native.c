@@ -0,0 +1,1034 @@
+#define _GNU_SOURCE
+#include "store_private.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/**
+ * @addtogroup Lib-Store-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+static Store_Conn * _store_native_conn_new(Store_Native *sn);
+static Eina_Bool _store_conn_start(Store_Conn *sc, Store_Batch *sb);
+static Eina_Bool _store_conn_connect(Store_Conn *sc, struct addrinfo *ai);
+
+/**
+ * @brief Splits an URL into host, port and path.
+ * @param sn Store_Native structure to fill.
+ * @param url URL like http://host[:port][/path], host can be an IPv6
+ *        address between brackets.
+ * @return EINA_TRUE on success, EINA_FALSE if URL is not supported.
+ */
+static Eina_Bool
+_store_native_url_parse(Store_Native *sn,
+                        const char *url)
+{
+   const char *authority,
+              *path,
+              *host,
+              *port = NULL;
+   size_t host_len;
+
+   if (strncasecmp(url, "http://", 7))
+     {
+        ERR("Native client only supports http URLs, not %s", url);
+        return EINA_FALSE;
+     }
+   authority = url + 7;
+
+   path = strchr(authority, '/');
+   if (!path)
+     path = authority + strlen(authority);
+
+   host = authority;
+   if (*host == '[')
+     {
+        host++;
+        host_len = strcspn(host, "]");
+        if (host + host_len >= path)
+          goto error;
+        if (host[host_len + 1] == ':')
+          port = host + host_len + 2;
+     }
+   else
+     {
+        host_len = strcspn(host, ":/");
+        if (host[host_len] == ':')
+          port = host + host_len + 1;
+     }
+   if ((!host_len) || ((port) && (port == path)))
+     goto error;
+
+   sn->host = store_utils_dupf("%.*s", (int)host_len, host);
+   sn->port = (port) ? store_utils_dupf("%.*s", (int)(path - port), port) :
+                       strdup("80");
+   sn->authority = store_utils_dupf("%.*s", (int)(path - authority),
+                                    authority);
+   sn->path = store_utils_dupf("%s", (*path) ? path : "/");
+   if ((!sn->host) || (!sn->port) || (!sn->authority) || (!sn->path))
+     {
+        ERR("Failed to allocate URL strings");
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+
+error:
+   ERR("Invalid URL %s", url);
+   return EINA_FALSE;
+}
+
+/**
+ * @brief Renders the constant part of request headers.
+ * @param sn Store_Native structure.
+ * @return EINA_TRUE on success, EINA_FALSE otherwise.
+ *
+ * Only Content-Length and a few headers depending on the batch are
+ * rendered for each request.
+ */
+static Eina_Bool
+_store_native_prefix_render(Store_Native *sn)
+{
+   const char *sep;
+
+   sep = (sn->path[strlen(sn->path) - 1] == '/') ? "" : "/";
+   sn->prefix[0].s = store_utils_dupf("POST %s HTTP/1.1\r\n"
+                                      "Host: %s\r\n"
+                                      "Content-Type: text/json\r\n",
+                                      sn->path, sn->authority);
+   sn->prefix[1].s = store_utils_dupf("POST %s%s_bulk HTTP/1.1\r\n"
+                                      "Host: %s\r\n"
+                                      "Content-Type: application/x-ndjson\r\n",
+                                      sn->path, sep, sn->authority);
+   if ((!sn->prefix[0].s) || (!sn->prefix[1].s))
+     {
+        ERR("Failed to allocate request headers");
+        return EINA_FALSE;
+     }
+   sn->prefix[0].len = strlen(sn->prefix[0].s);
+   sn->prefix[1].len = strlen(sn->prefix[1].s);
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Resolves the address of the server.
+ * @param sn Store_Native structure.
+ * @return EINA_TRUE on success, EINA_FALSE otherwise.
+ *
+ * Blocks the main loop, so the address is kept until a connection
+ * fails.
+ */
+static Eina_Bool
+_store_native_resolve(Store_Native *sn)
+{
+   struct addrinfo hints;
+   int r;
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+
+   r = getaddrinfo(sn->host, sn->port, &hints, &sn->ai);
+   if (r)
+     {
+        ERR("Failed to resolve %s : %s", sn->host, gai_strerror(r));
+        sn->ai = NULL;
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Updates the circuit breaker of the server from an answer.
+ * @param sn Store_Native structure.
+ * @param http_code HTTP code of the answer, 0 if there was none.
+ *
+ * Same breaker as endpoints of the http sink. A request without answer
+ * also forgets the address of the server, it is resolved again by the
+ * next connection. Connections still connecting then fail without
+ * trying the next addresses.
+ */
+static void
+_store_native_answer(Store_Native *sn,
+                     int http_code)
+{
+   Store *store = sn->store;
+   Store_Conn *sc;
+   Eina_List *l;
+
+   if (!store_request_failed(http_code))
+     {
+        if (sn->failures >= STORE_BREAKER_FAILURES)
+          NFO("Server %s is back", sn->authority);
+        sn->failures = 0;
+        return;
+     }
+
+   if ((!http_code) && (sn->ai))
+     {
+        EINA_LIST_FOREACH(sn->busy, l, sc)
+          sc->ai = NULL;
+        EINA_LIST_FOREACH(sn->idle, l, sc)
+          sc->ai = NULL;
+        freeaddrinfo(sn->ai);
+        sn->ai = NULL;
+     }
+
+   sn->failures++;
+   if (sn->failures < STORE_BREAKER_FAILURES)
+     return;
+
+   if (sn->failures == STORE_BREAKER_FAILURES)
+     WRN("Server %s is down (HTTP code %i)", sn->authority, http_code);
+   sn->retry = ecore_time_get() +
+      store_utils_backoff(store->retry.delay, store->retry.max_delay,
+                          sn->failures - STORE_BREAKER_FAILURES + 1);
+}
+
+/**
+ * @brief Frees a connection, without touching its batch or lists.
+ * @param sc Store_Conn structure.
+ */
+static void
+_store_conn_free(Store_Conn *sc)
+{
+   if (sc->fdh)
+     ecore_main_fd_handler_del(sc->fdh);
+   if (sc->fd >= 0)
+     close(sc->fd);
+   if (sc->timer)
+     ecore_timer_del(sc->timer);
+   eina_strbuf_free(sc->in.line);
+   eina_strbuf_free(sc->in.body);
+   free(sc);
+}
+
+/**
+ * @brief Ends the request of a connection with no answer, and frees it.
+ * @param sc Store_Conn structure.
+ * @param reason Why the request failed.
+ *
+ * A kept connection can be closed by the server while a new request is
+ * being sent over it. Such a request is sent once more over a new
+ * connection, as the server did not get it.
+ */
+static void
+_store_conn_fail(Store_Conn *sc,
+                 const char *reason)
+{
+   Store_Native *sn = sc->sn;
+   Store_Batch *sb = sc->batch;
+   Eina_Bool stale = (sc->reused) && (!sc->in.started);
+
+   if (!sb)
+     {
+        DBG("sc[%p] Closing idle connection", sc);
+        sn->idle = eina_list_remove(sn->idle, sc);
+        _store_conn_free(sc);
+        return;
+     }
+
+   sn->busy = eina_list_remove(sn->busy, sc);
+   sc->batch = NULL;
+   /* A running compression job must not send with this connection */
+   if (sb->gz)
+     sb->gz->ready.cb = NULL;
+   _store_conn_free(sc);
+
+   if (stale)
+     {
+        DBG("sb[%p] Kept connection was closed, sending again", sb);
+        sc = _store_native_conn_new(sn);
+        if (sc)
+          {
+             _store_conn_start(sc, sb);
+             return;
+          }
+     }
+
+   ERR("Request to %s failed : %s", sn->authority, reason);
+   store_rate_sent(sn->store, &sn->rate, sb, 0);
+   _store_native_answer(sn, 0);
+   store_request_done(sn->store, sb, 0, NULL, 0);
+}
+
+static Eina_Bool
+_store_conn_timeout(void *data)
+{
+   Store_Conn *sc = data;
+
+   sc->timer = NULL;
+   sc->reused = EINA_FALSE;
+   _store_conn_fail(sc, "Timed out");
+   return EINA_FALSE;
+}
+
+/**
+ * @brief Sends what is left of the request of a connection.
+ * @param sc Store_Conn structure.
+ * @return EINA_FALSE if connection failed and was freed.
+ *
+ * Header and body go out of their own buffers, in as few calls as the
+ * socket allows. sendmsg() is used like writev(), MSG_NOSIGNAL keeping
+ * a closed connection from raising SIGPIPE.
+ */
+static Eina_Bool
+_store_conn_flush(Store_Conn *sc)
+{
+   struct iovec *iov;
+   struct msghdr msg;
+   ssize_t r;
+
+   while (sc->out.count)
+     {
+        iov = sc->out.iov + sc->out.first;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = sc->out.count;
+
+        r = sendmsg(sc->fd, &msg, MSG_NOSIGNAL);
+        if (r < 0)
+          {
+             if (errno == EINTR)
+               continue;
+             if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+               {
+                  ecore_main_fd_handler_active_set(sc->fdh,
+                                                   ECORE_FD_READ |
+                                                   ECORE_FD_WRITE);
+                  return EINA_TRUE;
+               }
+             _store_conn_fail(sc, strerror(errno));
+             return EINA_FALSE;
+          }
+
+        while ((sc->out.count) && ((size_t)r >= iov->iov_len))
+          {
+             r -= iov->iov_len;
+             iov++;
+             sc->out.first++;
+             sc->out.count--;
+          }
+        if (sc->out.count)
+          {
+             iov->iov_base = (char *)iov->iov_base + r;
+             iov->iov_len -= r;
+          }
+     }
+
+   ecore_main_fd_handler_active_set(sc->fdh, ECORE_FD_READ);
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Renders the headers of a request, and starts sending it.
+ * @param sc Store_Conn structure, holding a batch.
+ * @return EINA_FALSE if connection failed and was freed.
+ *
+ * The compressed body is sent if there is one, the raw body otherwise.
+ * Neither is copied.
+ */
+static Eina_Bool
+_store_conn_request(Store_Conn *sc)
+{
+   Store_Native *sn = sc->sn;
+   Store_Batch *sb = sc->batch;
+   const void *body = eina_strbuf_string_get(sb->buf);
+   size_t len = eina_strbuf_length_get(sb->buf);
+   Eina_Bool gz = EINA_FALSE;
+   int n;
+
+   if ((sb->gz) && (sb->gz->done))
+     {
+        body = eina_binbuf_string_get(sb->gz->buf);
+        len = eina_binbuf_length_get(sb->gz->buf);
+        gz = EINA_TRUE;
+     }
+
+   n = snprintf(sc->out.head, sizeof(sc->out.head),
+                "%s%sContent-Length: %zu\r\n\r\n",
+                (gz) ? "Content-Encoding: gzip\r\n" : "",
+                (sn->keepalive > 0.0) ? "" : "Connection: close\r\n",
+                len);
+
+   sc->out.iov[0].iov_base = sn->prefix[sb->bulk].s;
+   sc->out.iov[0].iov_len = sn->prefix[sb->bulk].len;
+   sc->out.iov[1].iov_base = sc->out.head;
+   sc->out.iov[1].iov_len = n;
+   sc->out.iov[2].iov_base = (void *)body;
+   sc->out.iov[2].iov_len = len;
+   sc->out.first = 0;
+   sc->out.count = (len) ? 3 : 2;
+
+   DBG("store[%p] sc[%p] Sending %u documents, %zu bytes (%zu on the wire)",
+       sn->store, sc, sb->count, eina_strbuf_length_get(sb->buf), len);
+   store_rate_sent(sn->store, &sn->rate, sb, len);
+
+   if (sc->connecting)
+     return EINA_TRUE;
+   return _store_conn_flush(sc);
+}
+
+/**
+ * @brief Sends the batch of a connection once compressed.
+ * @param data Store_Conn structure.
+ */
+static void
+_store_conn_ready(void *data)
+{
+   _store_conn_request(data);
+}
+
+/**
+ * @brief Gives a batch to a connection.
+ * @param sc Store_Conn structure, idle or new.
+ * @param sb Batch to send.
+ * @return EINA_FALSE if connection failed and was freed, its batch
+ *         being ended.
+ */
+static Eina_Bool
+_store_conn_start(Store_Conn *sc,
+                  Store_Batch *sb)
+{
+   Store_Native *sn = sc->sn;
+
+   sc->batch = sb;
+   sn->busy = eina_list_append(sn->busy, sc);
+
+   sc->in.state = STORE_CONN_STATUS;
+   sc->in.status = 0;
+   sc->in.left = 0;
+   sc->in.started = EINA_FALSE;
+   sc->in.close = EINA_FALSE;
+   sc->in.chunked = EINA_FALSE;
+   sc->in.length = EINA_FALSE;
+   eina_strbuf_reset(sc->in.line);
+   eina_strbuf_reset(sc->in.body);
+
+   if (sc->timer)
+     ecore_timer_del(sc->timer);
+   sc->timer = ecore_timer_add(STORE_TIMEOUT, _store_conn_timeout, sc);
+
+   if (!store_gz_seal(sn->store, sb, _store_conn_ready, sc))
+     return EINA_TRUE;
+   return _store_conn_request(sc);
+}
+
+/**
+ * @brief Handles a line of the answer head, or of a chunked body.
+ * @param sc Store_Conn structure.
+ * @return EINA_FALSE if answer is invalid.
+ */
+static Eina_Bool
+_store_conn_line(Store_Conn *sc)
+{
+   size_t len = eina_strbuf_length_get(sc->in.line);
+   const char *s = eina_strbuf_string_get(sc->in.line),
+              *value;
+   unsigned long long size;
+   int major,
+       minor;
+   char *end;
+
+   while ((len) && ((s[len - 1] == '\n') || (s[len - 1] == '\r')))
+     len--;
+   eina_strbuf_remove(sc->in.line, len, eina_strbuf_length_get(sc->in.line));
+   s = eina_strbuf_string_get(sc->in.line);
+
+   switch (sc->in.state)
+     {
+      case STORE_CONN_STATUS:
+         if (sscanf(s, "HTTP/%d.%d %d", &major, &minor, &sc->in.status) != 3)
+           return EINA_FALSE;
+         /* HTTP/1.0 servers close connections unless told otherwise */
+         sc->in.close = ((major == 1) && (minor == 0));
+         sc->in.chunked = EINA_FALSE;
+         sc->in.length = EINA_FALSE;
+         sc->in.state = STORE_CONN_HEADERS;
+         return EINA_TRUE;
+
+      case STORE_CONN_HEADERS:
+         if (len)
+           break;
+
+         if (sc->in.status / 100 == 1)
+           sc->in.state = STORE_CONN_STATUS;
+         else if (sc->in.chunked)
+           sc->in.state = STORE_CONN_CHUNK_SIZE;
+         else if (sc->in.length)
+           sc->in.state = (sc->in.left) ? STORE_CONN_BODY : STORE_CONN_DONE;
+         else if ((sc->in.status == 204) || (sc->in.status == 304))
+           sc->in.state = STORE_CONN_DONE;
+         else
+           {
+              sc->in.state = STORE_CONN_BODY_EOF;
+              sc->in.close = EINA_TRUE;
+           }
+         return EINA_TRUE;
+
+      case STORE_CONN_CHUNK_SIZE:
+         size = strtoull(s, &end, 16);
+         if (end == s)
+           return EINA_FALSE;
+         sc->in.left = size;
+         sc->in.state = (size) ? STORE_CONN_CHUNK_DATA : STORE_CONN_TRAILERS;
+         return EINA_TRUE;
+
+      case STORE_CONN_CHUNK_END:
+         if (len)
+           return EINA_FALSE;
+         sc->in.state = STORE_CONN_CHUNK_SIZE;
+         return EINA_TRUE;
+
+      case STORE_CONN_TRAILERS:
+         if (!len)
+           sc->in.state = STORE_CONN_DONE;
+         return EINA_TRUE;
+
+      default:
+         return EINA_FALSE;
+     }
+
+   value = strchr(s, ':');
+   if (!value)
+     return EINA_FALSE;
+   value++;
+   while ((*value == ' ') || (*value == '\t'))
+     value++;
+
+   if (!strncasecmp(s, "Content-Length:", 15))
+     {
+        size = strtoull(value, &end, 10);
+        if (end == value)
+          return EINA_FALSE;
+        sc->in.left = size;
+        sc->in.length = EINA_TRUE;
+     }
+   else if (!strncasecmp(s, "Transfer-Encoding:", 18))
+     sc->in.chunked = !!strcasestr(value, "chunked");
+   else if (!strncasecmp(s, "Connection:", 11))
+     {
+        if (strcasestr(value, "close"))
+          sc->in.close = EINA_TRUE;
+        else if (strcasestr(value, "keep-alive"))
+          sc->in.close = EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Parses bytes of the answer, as they come.
+ * @param sc Store_Conn structure.
+ * @param buf Bytes read.
+ * @param len Length of @p buf.
+ * @return 1 once the answer is complete, 0 if more bytes are needed,
+ *         -1 if answer is invalid.
+ *
+ * Lines of the head and of chunk sizes are gathered in a buffer, body
+ * bytes go straight to the answer.
+ */
+static int
+_store_conn_parse(Store_Conn *sc,
+                  const char *buf,
+                  size_t len)
+{
+   const char *nl;
+   size_t n;
+
+   while (len)
+     {
+        switch (sc->in.state)
+          {
+           case STORE_CONN_BODY:
+           case STORE_CONN_CHUNK_DATA:
+              n = (len < sc->in.left) ? len : sc->in.left;
+              eina_strbuf_append_length(sc->in.body, buf, n);
+              sc->in.left -= n;
+              if (!sc->in.left)
+                sc->in.state = (sc->in.state == STORE_CONN_BODY) ?
+                   STORE_CONN_DONE : STORE_CONN_CHUNK_END;
+              break;
+
+           case STORE_CONN_BODY_EOF:
+              n = len;
+              eina_strbuf_append_length(sc->in.body, buf, n);
+              break;
+
+           case STORE_CONN_DONE:
+              /* Nothing was asked for these bytes */
+              sc->in.close = EINA_TRUE;
+              return 1;
+
+           default:
+              nl = memchr(buf, '\n', len);
+              n = (nl) ? (size_t)(nl + 1 - buf) : len;
+              if (eina_strbuf_length_get(sc->in.line) + n > STORE_NATIVE_LINE_MAX)
+                return -1;
+              eina_strbuf_append_length(sc->in.line, buf, n);
+              if ((nl) && (!_store_conn_line(sc)))
+                return -1;
+              if (nl)
+                eina_strbuf_reset(sc->in.line);
+              break;
+          }
+        buf += n;
+        len -= n;
+     }
+   return (sc->in.state == STORE_CONN_DONE);
+}
+
+static Eina_Bool
+_store_conn_idle_timeout(void *data)
+{
+   Store_Conn *sc = data;
+
+   sc->timer = NULL;
+   _store_conn_fail(sc, NULL);
+   return EINA_FALSE;
+}
+
+/**
+ * @brief Ends the request of a connection once answered.
+ * @param sc Store_Conn structure.
+ *
+ * The connection is kept for the next request, unless the server closes
+ * it or the request was not fully sent.
+ */
+static void
+_store_conn_done(Store_Conn *sc)
+{
+   Store_Native *sn = sc->sn;
+   Store_Batch *sb = sc->batch;
+   int http_code = sc->in.status;
+   Eina_Bool keep;
+
+   ecore_timer_del(sc->timer);
+   sc->timer = NULL;
+
+   sn->busy = eina_list_remove(sn->busy, sc);
+   sc->batch = NULL;
+
+   _store_native_answer(sn, http_code);
+   if (store_request_failed(http_code))
+     DBG("sc[%p] Request failed with HTTP code %i", sc, http_code);
+
+   keep = (!sc->in.close) && (!sc->out.count) && (sn->keepalive > 0.0);
+   if (keep)
+     {
+        sc->reused = EINA_TRUE;
+        sc->timer = ecore_timer_add(sn->keepalive, _store_conn_idle_timeout, sc);
+        sn->idle = eina_list_prepend(sn->idle, sc);
+     }
+
+   /* Answer is only reset by the next request of the connection */
+   store_request_done(sn->store, sb, http_code,
+                      (char *)eina_strbuf_string_get(sc->in.body),
+                      eina_strbuf_length_get(sc->in.body));
+
+   if (!keep)
+     _store_conn_free(sc);
+}
+
+/**
+ * @brief Reads what the server sent, until the socket is drained.
+ * @param sc Store_Conn structure.
+ */
+static void
+_store_conn_read(Store_Conn *sc)
+{
+   char buf[STORE_NATIVE_READ];
+   ssize_t r;
+   int parsed;
+
+   for (;;)
+     {
+        r = read(sc->fd, buf, sizeof(buf));
+        if (r < 0)
+          {
+             if (errno == EINTR)
+               continue;
+             if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+               _store_conn_fail(sc, strerror(errno));
+             return;
+          }
+
+        /* Idle connections are closed by any event */
+        if (!sc->batch)
+          {
+             _store_conn_fail(sc, NULL);
+             return;
+          }
+
+        if (!r)
+          {
+             if (sc->in.state == STORE_CONN_BODY_EOF)
+               _store_conn_done(sc);
+             else
+               _store_conn_fail(sc, "Connection closed by server");
+             return;
+          }
+
+        sc->in.started = EINA_TRUE;
+        parsed = _store_conn_parse(sc, buf, r);
+        if (parsed < 0)
+          {
+             _store_conn_fail(sc, "Invalid answer");
+             return;
+          }
+        if (parsed)
+          {
+             _store_conn_done(sc);
+             return;
+          }
+     }
+}
+
+static Eina_Bool
+_store_conn_event(void *data,
+                  Ecore_Fd_Handler *fdh)
+{
+   Store_Conn *sc = data;
+   socklen_t len;
+   int err = 0;
+
+   if (sc->connecting)
+     {
+        if (!ecore_main_fd_handler_active_get(fdh, ECORE_FD_WRITE))
+          return ECORE_CALLBACK_RENEW;
+
+        len = sizeof(err);
+        if (getsockopt(sc->fd, SOL_SOCKET, SO_ERROR, &err, &len))
+          err = errno;
+        if (err)
+          {
+             DBG("sc[%p] Failed to connect : %s", sc, strerror(err));
+             if ((!sc->ai) || (!_store_conn_connect(sc, sc->ai->ai_next)))
+               _store_conn_fail(sc, strerror(err));
+             return ECORE_CALLBACK_RENEW;
+          }
+
+        sc->connecting = EINA_FALSE;
+        if (sc->out.count)
+          _store_conn_flush(sc);
+        else
+          ecore_main_fd_handler_active_set(fdh, ECORE_FD_READ);
+        return ECORE_CALLBACK_RENEW;
+     }
+
+   if ((sc->out.count) &&
+       (ecore_main_fd_handler_active_get(fdh, ECORE_FD_WRITE)) &&
+       (!_store_conn_flush(sc)))
+     return ECORE_CALLBACK_RENEW;
+
+   if (ecore_main_fd_handler_active_get(fdh, ECORE_FD_READ))
+     _store_conn_read(sc);
+   return ECORE_CALLBACK_RENEW;
+}
+
+/**
+ * @brief Connects a connection to the first address that accepts it.
+ * @param sc Store_Conn structure.
+ * @param ai First address to try, next ones being tried in turn.
+ * @return EINA_FALSE once every address failed.
+ *
+ * The socket of a previous address is closed first. The connection is
+ * non-blocking, a connect failing later on tries the next address from
+ * _store_conn_event().
+ */
+static Eina_Bool
+_store_conn_connect(Store_Conn *sc,
+                    struct addrinfo *ai)
+{
+   Store_Native *sn = sc->sn;
+   int on = 1;
+
+   if (sc->fdh)
+     {
+        ecore_main_fd_handler_del(sc->fdh);
+        sc->fdh = NULL;
+     }
+   if (sc->fd >= 0)
+     {
+        close(sc->fd);
+        sc->fd = -1;
+     }
+   sc->connecting = EINA_FALSE;
+
+   for (; ai; ai = ai->ai_next)
+     {
+        sc->fd = socket(ai->ai_family,
+                        ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        ai->ai_protocol);
+        if (sc->fd < 0)
+          {
+             ERR("Failed to create socket : %s", strerror(errno));
+             continue;
+          }
+
+        if ((sn->nodelay) &&
+            (setsockopt(sc->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on))))
+          WRN("Failed to set TCP_NODELAY : %s", strerror(errno));
+        if ((sn->keepalive > 0.0) &&
+            (setsockopt(sc->fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on))))
+          WRN("Failed to set SO_KEEPALIVE : %s", strerror(errno));
+
+        if (!connect(sc->fd, ai->ai_addr, ai->ai_addrlen))
+          break;
+        if (errno == EINPROGRESS)
+          {
+             sc->connecting = EINA_TRUE;
+             break;
+          }
+
+        ERR("Failed to connect to %s : %s", sn->authority, strerror(errno));
+        close(sc->fd);
+        sc->fd = -1;
+     }
+
+   sc->ai = ai;
+   if (!ai)
+     return EINA_FALSE;
+
+   sc->fdh = ecore_main_fd_handler_add(sc->fd, (sc->connecting) ?
+                                       ECORE_FD_WRITE : ECORE_FD_READ,
+                                       _store_conn_event, sc, NULL, NULL);
+   if (!sc->fdh)
+     {
+        ERR("Failed to add fd handler");
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Opens a new connection to the server.
+ * @param sn Store_Native structure.
+ * @return New Store_Conn structure, NULL on failure.
+ *
+ * The connection is non-blocking, being established while the body is
+ * compressed. Addresses of the server are tried in turn.
+ */
+static Store_Conn *
+_store_native_conn_new(Store_Native *sn)
+{
+   Store_Conn *sc;
+
+   if ((!sn->ai) && (!_store_native_resolve(sn)))
+     return NULL;
+
+   sc = calloc(1, sizeof(Store_Conn));
+   if (!sc)
+     {
+        ERR("Failed to allocate Store_Conn structure");
+        return NULL;
+     }
+   sc->sn = sn;
+   sc->fd = -1;
+
+   sc->in.line = eina_strbuf_new();
+   sc->in.body = eina_strbuf_new();
+   if ((!sc->in.line) || (!sc->in.body))
+     {
+        ERR("Failed to allocate answer buffers");
+        goto sc_free;
+     }
+
+   if (!_store_conn_connect(sc, sn->ai))
+     goto sc_free;
+   return sc;
+
+sc_free:
+   _store_conn_free(sc);
+   return NULL;
+}
+
+static void *
+_store_native_open(Store *store,
+                   const char *target)
+{
+   Store_Native *sn;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(target, NULL);
+
+   sn = calloc(1, sizeof(Store_Native));
+   if (!sn)
+     {
+        ERR("Failed to allocate Store_Native structure");
+        return NULL;
+     }
+   sn->store = store;
+   sn->nodelay = EINA_TRUE;
+   sn->keepalive = STORE_NATIVE_KEEPALIVE;
+
+   if ((!_store_native_url_parse(sn, target)) ||
+       (!_store_native_prefix_render(sn)))
+     goto sn_free;
+   return sn;
+
+sn_free:
+   free(sn->host);
+   free(sn->port);
+   free(sn->authority);
+   free(sn->path);
+   free(sn->prefix[0].s);
+   free(sn->prefix[1].s);
+   free(sn);
+   return NULL;
+}
+
+static void
+_store_native_close(void *data)
+{
+   Store_Native *sn = data;
+   Store_Batch *sb;
+   Store_Conn *sc;
+
+   EINA_LIST_FREE(sn->busy, sc)
+     {
+        sb = sc->batch;
+        if (sb->gz)
+          sb->gz->ready.cb = NULL;
+        _store_conn_free(sc);
+        store_request_done(sn->store, sb, 0, NULL, 0);
+     }
+   EINA_LIST_FREE(sn->idle, sc)
+     _store_conn_free(sc);
+
+   if (sn->ai)
+     freeaddrinfo(sn->ai);
+   free(sn->host);
+   free(sn->port);
+   free(sn->authority);
+   free(sn->path);
+   free(sn->prefix[0].s);
+   free(sn->prefix[1].s);
+   free(sn);
+}
+
+/**
+ * @brief Tells if the server can take a request.
+ * @param data Store_Native structure.
+ * @param req Request to send, NULL for any request.
+ * @param when Set to when a probe or a paced request can be sent.
+ * @return STORE_SINK_DOWN while the breaker is open, STORE_SINK_BUSY
+ *         while a probe is running, STORE_SINK_PACED while waiting for
+ *         bandwidth, unless @p req is of the priority lane.
+ */
+static Store_Sink_State
+_store_native_state(void *data,
+                    Store_Request *req,
+                    double *when)
+{
+   Store_Native *sn = data;
+
+   if (sn->failures >= STORE_BREAKER_FAILURES)
+     {
+        if (sn->busy)
+          return STORE_SINK_BUSY;
+
+        if (ecore_time_get() < sn->retry)
+          {
+             *when = sn->retry;
+             return STORE_SINK_DOWN;
+          }
+     }
+
+   if ((req) && (req->priority))
+     return STORE_SINK_READY;
+
+   *when = store_rate_when(&sn->rate);
+   return (*when > 0.0) ? STORE_SINK_PACED : STORE_SINK_READY;
+}
+
+/**
+ * @brief Sends a batch over a kept connection, or a new one.
+ * @param data Store_Native structure.
+ * @param sb Batch to send.
+ * @return EINA_TRUE if request is sent, EINA_FALSE otherwise.
+ *
+ * On failure, caller keeps ownership of @p sb.
+ */
+static Eina_Bool
+_store_native_send(void *data,
+                   Store_Request *sb)
+{
+   Store_Native *sn = data;
+   Store_Conn *sc;
+
+   if (sn->idle)
+     {
+        sc = eina_list_data_get(sn->idle);
+        sn->idle = eina_list_remove_list(sn->idle, sn->idle);
+     }
+   else
+     {
+        sc = _store_native_conn_new(sn);
+        if (!sc)
+          {
+             _store_native_answer(sn, 0);
+             return EINA_FALSE;
+          }
+     }
+
+   store_rate_take(&sn->rate, sb->charged);
+   _store_conn_start(sc, sb);
+   return EINA_TRUE;
+}
+
+/**
+ * @endcond
+ */
+
+const Store_Sink_Class store_sink_native =
+{
+   "native",
+   _store_native_open,
+   _store_native_close,
+   _store_native_state,
+   _store_native_send
+};
+
+/**
+ * @brief Set how the native client uses its connections.
+ * @param store Store structure, created with store_sink_native.
+ * @param nodelay EINA_TRUE to set TCP_NODELAY on connections.
+ * @param keepalive Seconds an idle connection is kept for the next
+ *        request, 0 for default, negative to close connections after
+ *        each request.
+ *
+ * Settings apply to connections opened afterwards. Kept connections
+ * also have TCP keep-alive probes on.
+ */
+void
+store_native_set(Store *store,
+                 Eina_Bool nodelay,
+                 double keepalive)
+{
+   Store_Native *sn;
+
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   if (store->sink.cls != &store_sink_native)
+     {
+        ERR("store[%p] Not a native sink", store);
+        return;
+     }
+   sn = store->sink.data;
+
+   sn->nodelay = nodelay;
+   sn->keepalive = (keepalive != 0.0) ? keepalive : STORE_NATIVE_KEEPALIVE;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,583 @@
+#include "store_private.h"
+
+/**
+ * @addtogroup Lib-Store-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+static Eina_Bool
+_store_queue_timer(void *data)
+{
+   Store *store = data;
+
+   store->queue.timer = NULL;
+   store_queue_run(store);
+   return EINA_FALSE;
+}
+
+/**
+ * @brief Runs the queue again at a given time.
+ * @param store Store structure.
+ * @param when ecore_time_get() time to run the queue at.
+ */
+static void
+_store_queue_wait(Store *store,
+                  double when)
+{
+   double now = ecore_time_get();
+
+   if (store->queue.timer)
+     {
+        if (store->queue.when <= when)
+          return;
+        ecore_timer_del(store->queue.timer);
+     }
+   store->queue.when = when;
+   store->queue.timer = ecore_timer_add((when > now) ? when - now : 0.0,
+                                        _store_queue_timer, store);
+}
+
+/**
+ * @brief Runs the queue again once bandwidth lets a request start.
+ * @param store Store structure.
+ * @param when ecore_time_get() time a request can start at.
+ *
+ * Only counts a new wait, not the queue being run again meanwhile.
+ */
+static void
+_store_queue_paced(Store *store,
+                   double when)
+{
+   if ((!store->queue.timer) || (store->queue.when > when))
+     store->rate.paced++;
+   _store_queue_wait(store, when);
+}
+
+/**
+ * @brief Tells if a request failed in a way worth trying again.
+ * @param http_code HTTP code of the answer, 0 if there was none.
+ * @return EINA_TRUE if server could not handle the request.
+ */
+Eina_Bool
+store_request_failed(int http_code)
+{
+   return (!http_code) || (http_code == 429) || (http_code >= 500);
+}
+
+/**
+ * @brief Queues a batch, to be sent once a request slot is free.
+ * @param store Store structure.
+ * @param sb Batch to send, owned by the queue.
+ *
+ * With a spool, batches go to disk instead of memory when the sink can
+ * not take requests, when slots and memory queue are full, or when older
+ * batches are already spooled. Batches of the priority lane always stay
+ * in memory, as do batches waiting for bandwidth, so that pacing ends
+ * up throttling the app instead of filling the spool.
+ */
+void
+store_queue_push(Store *store,
+                 Store_Batch *sb)
+{
+   Store_Spool *sp = store->spool;
+   Store_Sink_State state;
+   Eina_Bool paced;
+   double when;
+
+   if (sb->priority)
+     {
+        store->priority.pending = eina_list_append(store->priority.pending,
+                                                   sb);
+        store->priority.pending_count++;
+        store->queue.bytes += eina_strbuf_length_get(sb->buf);
+        store_queue_run(store);
+        store_throttle_check(store);
+        return;
+     }
+
+   if (sp)
+     {
+        state = store->sink.cls->state(store->sink.data, NULL, &when);
+        paced = (state == STORE_SINK_PACED) ||
+                (store_rate_when(&store->rate.global) > 0.0);
+
+        if (((store_spool_has_data(sp)) ||
+             ((!paced) &&
+              ((state != STORE_SINK_READY) ||
+               (store->queue.pending_count >= store_adapt_inflight(store))))) &&
+            (store_spool_write(sp, sb)))
+          {
+             store_batch_free(sb);
+             store_queue_run(store);
+             return;
+          }
+     }
+
+   store->queue.pending = eina_list_append(store->queue.pending, sb);
+   store->queue.pending_count++;
+   store->queue.bytes += eina_strbuf_length_get(sb->buf);
+   store_queue_run(store);
+   store_throttle_check(store);
+}
+
+/**
+ * @brief Sends batches of the priority lane, while its slots are free.
+ * @param store Store structure.
+ *
+ * Failed batches go first once their retry time is over, then batches
+ * waiting in memory. When the sink can not take them, the queue runs
+ * again once it can, and the bulk lane still gets its turn.
+ */
+static void
+_store_queue_priority_run(Store *store)
+{
+   Store_Batch *sb,
+               *retry;
+   Eina_List **from;
+   Store_Sink_State state;
+   double now,
+          when;
+
+   while (store->priority.inflight < store->priority.max_inflight)
+     {
+        now = ecore_time_get();
+        retry = eina_list_data_get(store->priority.retry);
+        if ((retry) && (retry->retry <= now))
+          from = &store->priority.retry;
+        else if (store->priority.pending)
+          from = &store->priority.pending;
+        else
+          {
+             if (retry)
+               _store_queue_wait(store, retry->retry);
+             break;
+          }
+
+        sb = eina_list_data_get(*from);
+        state = store->sink.cls->state(store->sink.data, sb, &when);
+        if (state != STORE_SINK_READY)
+          {
+             if (state == STORE_SINK_PACED)
+               _store_queue_paced(store, when);
+             else if (state == STORE_SINK_DOWN)
+               _store_queue_wait(store, when);
+             break;
+          }
+
+        *from = eina_list_remove_list(*from, *from);
+        store->priority.pending_count--;
+
+        store->priority.inflight++;
+        store_rate_start(store, sb);
+        if (!store->sink.cls->send(store->sink.data, sb))
+          {
+             store_rate_sent(store, NULL, sb, 0);
+             store->priority.inflight--;
+             store_batch_retry(store, sb, 0);
+          }
+     }
+}
+
+/**
+ * @brief Sends pending batches, oldest first, while slots are free.
+ * @param store Store structure.
+ *
+ * Batches of the priority lane go first, with slots of their own. Then
+ * failed batches go once their retry time is over, then batches
+ * waiting in memory, then batches of the spool, as long as the sink can
+ * take them and bandwidth limits let them start.<br />
+ * Sinks ending requests right away call it again from their send
+ * function, which returns at once.
+ */
+void
+store_queue_run(Store *store)
+{
+   Store_Spool *sp = store->spool;
+   Store_Batch *sb,
+               *retry;
+   Eina_List **from;
+   Store_Sink_State state;
+   double now,
+          when;
+
+   if (store->queue.running)
+     return;
+
+   store->queue.running = EINA_TRUE;
+   _store_queue_priority_run(store);
+
+   while (store->queue.inflight < store_adapt_inflight(store))
+     {
+        now = ecore_time_get();
+        retry = eina_list_data_get(store->queue.retry);
+        if ((retry) && (retry->retry <= now))
+          from = &store->queue.retry;
+        else if (store->queue.pending)
+          from = &store->queue.pending;
+        else if ((sp) && (store_spool_has_data(sp)))
+          {
+             if ((sp->replay_rate > 0.0) && (now < sp->replay_next))
+               {
+                  _store_queue_wait(store, sp->replay_next);
+                  break;
+               }
+             from = NULL;
+          }
+        else
+          {
+             if (retry)
+               _store_queue_wait(store, retry->retry);
+             break;
+          }
+
+        when = store_rate_when(&store->rate.global);
+        if (when > 0.0)
+          {
+             _store_queue_paced(store, when);
+             break;
+          }
+
+        sb = (from) ? eina_list_data_get(*from) : NULL;
+        state = store->sink.cls->state(store->sink.data, sb, &when);
+        if (state != STORE_SINK_READY)
+          {
+             if (state == STORE_SINK_PACED)
+               _store_queue_paced(store, when);
+             else if (state == STORE_SINK_DOWN)
+               _store_queue_wait(store, when);
+             break;
+          }
+
+        if (from)
+          {
+             *from = eina_list_remove_list(*from, *from);
+             store->queue.pending_count--;
+          }
+        else
+          {
+             if (sp->replay_rate > 0.0)
+               sp->replay_next = now + 1.0 / sp->replay_rate;
+
+             sb = store_spool_read(sp);
+             if (!sb)
+               break;
+             store->queue.bytes += eina_strbuf_length_get(sb->buf);
+          }
+
+        store->queue.inflight++;
+        sb->sent = now;
+        store_rate_start(store, sb);
+        if (!store->sink.cls->send(store->sink.data, sb))
+          {
+             store_rate_sent(store, NULL, sb, 0);
+             store->queue.inflight--;
+             store_batch_retry(store, sb, 0);
+          }
+     }
+   store->queue.running = EINA_FALSE;
+}
+
+/**
+ * @brief Tells the app to stop or resume reading, from memory usage.
+ * @param store Store structure.
+ *
+ * Throttling starts when bytes held in memory or pending batches go
+ * above their high water mark, and stops once both are below their
+ * low water mark.
+ */
+void
+store_throttle_check(Store *store)
+{
+   size_t bytes = store->queue.bytes;
+
+   if (store->batch.current)
+     bytes += eina_strbuf_length_get(store->batch.current->buf);
+
+   if (!store->throttle.on)
+     {
+        if ((bytes < store->throttle.high_bytes) &&
+            (store->queue.pending_count < store->throttle.high_batches))
+          return;
+
+        WRN("store[%p] Throttling, %zu bytes and %u batches waiting",
+            store, bytes, store->queue.pending_count);
+        store->throttle.on = EINA_TRUE;
+        store->throttle.count++;
+        store->throttle.start = ecore_time_get();
+     }
+   else
+     {
+        if ((bytes > store->throttle.low_bytes) ||
+            (store->queue.pending_count > store->throttle.low_batches))
+          return;
+
+        NFO("store[%p] Not throttling anymore", store);
+        store->throttle.on = EINA_FALSE;
+        store->throttle.time += ecore_time_get() - store->throttle.start;
+     }
+
+   if (store->throttle.cb)
+     store->throttle.cb((void *)store->throttle.data, store,
+                        store->throttle.on);
+}
+
+/**
+ * @endcond
+ */
+
+/**
+ * @brief End a request given to the send function of a sink.
+ * @param store Store structure.
+ * @param req Request to end.
+ * @param status HTTP code of the answer, 0 if there was none.
+ * @param answer Answer of the destination, NULL if there is none. It is
+ *        modified in place while callbacks are called.
+ * @param len Length of @p answer.
+ *
+ * Requests ending with status 0, 429 or 5xx are sent again later, and
+ * go to the spool once out of attempts. Otherwise, documents are given
+ * their entry of a _bulk answer, or the whole answer of a single
+ * document. With a 2xx status and no answer, every document is done.
+ */
+void
+store_request_done(Store *store,
+                   Store_Request *req,
+                   int status,
+                   char *answer,
+                   size_t len)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+   EINA_SAFETY_ON_NULL_RETURN(req);
+
+   if (req->priority)
+     store->priority.inflight--;
+   else
+     {
+        if (!store->queue.stopped)
+          store_adapt_done(store, req, status);
+        store->queue.inflight--;
+     }
+   if (store_request_failed(status))
+     store_batch_retry(store, req, status);
+   else
+     {
+        store_batch_complete(store, req, status, answer, len);
+        store->queue.bytes -= eina_strbuf_length_get(req->buf);
+        if (req->segment)
+          store_spool_release(store->spool, req->segment);
+        store_batch_free(req);
+     }
+
+   if (store->queue.stopped)
+     return;
+   store_queue_run(store);
+   store_throttle_check(store);
+}
+
+/**
+ * @brief Set how many requests can be sent at once.
+ * @param store Store structure.
+ * @param max_inflight Max number of requests, 0 for default.
+ *
+ * The limit is shared by all endpoints. Requests above this limit
+ * wait in a queue, and are sent in order as soon as a request is over. Each request slot keeps its
+ * connection open for the next request.
+ */
+void
+store_inflight_set(Store *store,
+                   unsigned int max_inflight)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   store->queue.max_inflight = (max_inflight) ?
+      max_inflight : STORE_MAX_INFLIGHT;
+   store_queue_run(store);
+}
+
+/**
+ * @brief Set batches of the priority lane.
+ * @param store Store structure.
+ * @param max_docs Max number of documents in a batch, 0 for default.
+ * @param linger Max time a document waits in a batch, 0 for default.
+ * @param max_inflight Max requests of the lane sent at once, 0 for
+ *        default.
+ *
+ * Documents given to store_batch_priority_add() go in small batches,
+ * sent ahead of every other batch with request slots of their own, on
+ * top of the ones of store_inflight_set(). They never wait behind the
+ * spool, and only go to it once out of attempts.
+ */
+void
+store_priority_set(Store *store,
+                   unsigned int max_docs,
+                   double linger,
+                   unsigned int max_inflight)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   store->priority.max_docs = (max_docs) ? max_docs : STORE_PRIORITY_MAX_DOCS;
+   store->priority.linger = (linger > 0.0) ? linger : STORE_PRIORITY_LINGER;
+   store->priority.max_inflight = (max_inflight) ?
+      max_inflight : STORE_PRIORITY_INFLIGHT;
+   store_queue_run(store);
+}
+
+/**
+ * @brief Set how failed requests are tried again.
+ * @param store Store structure.
+ * @param attempts Max attempts to send a batch, 0 for default.
+ * @param delay Delay after the first failure, 0 for default.
+ * @param max_delay Max delay between two attempts, 0 for default.
+ *
+ * Requests failing with HTTP code 429, 5xx or without answer, and
+ * documents of a _bulk request rejected with such a status, are sent
+ * again after a delay doubling at each attempt, with random jitter.
+ * Once out of attempts, batches go to the spool if any, and their
+ * documents get an error otherwise.<br />
+ * The same delays apply to an endpoint whose requests keep failing.
+ */
+void
+store_retry_set(Store *store,
+                unsigned int attempts,
+                double delay,
+                double max_delay)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   store->retry.attempts = (attempts) ? attempts : STORE_RETRY_ATTEMPTS;
+   store->retry.delay = (delay > 0.0) ? delay : STORE_RETRY_DELAY;
+   store->retry.max_delay = (max_delay > 0.0) ?
+      max_delay : STORE_RETRY_MAX_DELAY;
+   if (store->retry.max_delay < store->retry.delay)
+     store->retry.max_delay = store->retry.delay;
+}
+
+/**
+ * @brief Set when Store asks the app to stop reading.
+ * @param store Store structure.
+ * @param high_bytes Throttle when that many bytes are held in memory.
+ * @param low_bytes Stop throttling below that many bytes.
+ * @param high_batches Throttle when that many batches wait to be sent.
+ * @param low_batches Stop throttling below that many batches.
+ *
+ * 0 keeps the default value of a mark.
+ */
+void
+store_watermarks_set(Store *store,
+                     size_t high_bytes,
+                     size_t low_bytes,
+                     unsigned int high_batches,
+                     unsigned int low_batches)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   store->throttle.high_bytes = (high_bytes) ? high_bytes : STORE_HIGH_BYTES;
+   store->throttle.low_bytes = (low_bytes) ? low_bytes : STORE_LOW_BYTES;
+   store->throttle.high_batches = (high_batches) ?
+      high_batches : STORE_HIGH_BATCHES;
+   store->throttle.low_batches = (low_batches) ?
+      low_batches : STORE_LOW_BATCHES;
+
+   if (store->throttle.low_bytes > store->throttle.high_bytes)
+     store->throttle.low_bytes = store->throttle.high_bytes;
+   if (store->throttle.low_batches > store->throttle.high_batches)
+     store->throttle.low_batches = store->throttle.high_batches;
+   store_throttle_check(store);
+}
+
+/**
+ * @brief Set the callback telling the app to stop or resume reading.
+ * @param store Store structure.
+ * @param throttle_cb Callback, called with EINA_TRUE when the app should
+ *        stop giving documents, and EINA_FALSE when it can start again.
+ * @param data Data to pass to callback.
+ */
+void
+store_throttle_callback_set(Store *store,
+                            Store_Throttle_Cb throttle_cb,
+                            const void *data)
+{
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   store->throttle.cb = throttle_cb;
+   store->throttle.data = data;
+}
+
+/**
+ * @brief Get the counters of a Store.
+ * @param store Store structure.
+ * @param stats Store_Stats structure to fill.
+ */
+void
+store_stats_get(Store *store,
+                Store_Stats *stats)
+{
+   Store_Endpoint *se;
+   Eina_List *l;
+
+   EINA_SAFETY_ON_NULL_RETURN(store);
+   EINA_SAFETY_ON_NULL_RETURN(stats);
+
+   memset(stats, 0, sizeof(Store_Stats));
+   stats->inflight = store->queue.inflight + store->priority.inflight;
+   stats->priority_inflight = store->priority.inflight;
+   stats->priority_pending = store->priority.pending_count;
+   if (store->sink.cls == &store_sink_http)
+     {
+        Store_Http *sh = store->sink.data;
+
+        EINA_LIST_FOREACH(sh->endpoints, l, se)
+          {
+             stats->endpoints++;
+             if (STORE_ENDPOINT_OPEN(se))
+               stats->endpoints_down++;
+          }
+     }
+   else if (store->sink.cls == &store_sink_native)
+     {
+        Store_Native *sn = store->sink.data;
+
+        stats->endpoints = 1;
+        stats->endpoints_down = (sn->failures >= STORE_BREAKER_FAILURES);
+     }
+   stats->pending = store->queue.pending_count;
+   stats->bytes = store->queue.bytes;
+   if (store->batch.current)
+     stats->bytes += eina_strbuf_length_get(store->batch.current->buf);
+
+   if (store->spool)
+     {
+        stats->spool_bytes = store->spool->bytes;
+        stats->spool_dropped = store->spool->dropped;
+     }
+
+   stats->throttled = store->throttle.on;
+   stats->throttled_count = store->throttle.count;
+   stats->throttled_time = store->throttle.time;
+   if (store->throttle.on)
+     stats->throttled_time += ecore_time_get() - store->throttle.start;
+
+   stats->adaptive = (store->adapt.target > 0.0);
+   stats->batch_docs = store_adapt_docs(store);
+   stats->batch_bytes = store_adapt_bytes(store);
+   stats->batch_linger = store_adapt_linger(store);
+   stats->max_inflight = store_adapt_inflight(store);
+   stats->latency = store->adapt.latency;
+   stats->doc_cost = store->adapt.doc_cost;
+   stats->adapt_increases = store->adapt.increases;
+   stats->adapt_decreases = store->adapt.decreases;
+
+   stats->rate_limit = store->rate.global.limit;
+   stats->endpoint_rate_limit = store->rate.endpoint;
+   stats->rate = store_rate_measured(store);
+   stats->bytes_sent = store->rate.total;
+   stats->paced = store->rate.paced;
+}
+
+/**
+ * @}
+ */
@@ -1,5 +1,9 @@
 #include <Store.h>
 
+#include <stdint.h>
+#include <sys/uio.h>
+#include <zlib.h>
+
 /**
  * @addtogroup Lib-Store-Functions
  * @{
@@ -16,51 +20,482 @@ extern int _store_log_dom_global;
 #define WRN(...) EINA_LOG_DOM_WARN(_store_log_dom_global, __VA_ARGS__)
 #define CRI(...) EINA_LOG_DOM_CRIT(_store_log_dom_global, __VA_ARGS__)
 
+#define STORE_BATCH_MAX_DOCS 500
+#define STORE_BATCH_MAX_BYTES (5 * 1024 * 1024)
+#define STORE_BATCH_LINGER 1.0
+#define STORE_MAX_INFLIGHT 4
+#define STORE_TIMEOUT 10.0
+#define STORE_ADD_MAGIC 0x570AE4DDu
+#define STORE_RETRY_ATTEMPTS 5
+#define STORE_RETRY_DELAY 0.5
+#define STORE_RETRY_MAX_DELAY 60.0
+#define STORE_BREAKER_FAILURES 3
+#define STORE_SPOOL_MAGIC 0x53504F4Cu
+#define STORE_SPOOL_SEGMENT_SIZE (16 * 1024 * 1024)
+#define STORE_SPOOL_WRITE_SIZE (256 * 1024)
+#define STORE_SPOOL_FLUSH 0.5
+#define STORE_HIGH_BYTES (64 * 1024 * 1024)
+#define STORE_LOW_BYTES (32 * 1024 * 1024)
+#define STORE_HIGH_BATCHES 64
+#define STORE_LOW_BATCHES 16
+#define STORE_GZ_CHUNK (64 * 1024)
+#define STORE_GZ_MIN 1024
+#define STORE_FILE_MAX_BYTES (128 * 1024 * 1024)
+#define STORE_FILE_MAX_AGE 3600.0
+#define STORE_FILE_SYNC 1.0
+#define STORE_FILE_IOV 128 /* Below IOV_MAX of common systems */
+#define STORE_PRIORITY_MAX_DOCS 50
+#define STORE_PRIORITY_LINGER 0.05
+#define STORE_PRIORITY_INFLIGHT 2
+#define STORE_ADAPT_ALPHA 0.2 /* Weight of a sample in moving averages */
+#define STORE_ADAPT_DECREASE 0.5
+#define STORE_ADAPT_STEP (1.0 / 32)
+#define STORE_ADAPT_MIN_SCALE (1.0 / 64)
+#define STORE_ADAPT_MIN_LINGER 0.1 /* Share of target latency */
+#define STORE_RATE_BURST 1.0 /* Seconds of bytes a bucket holds */
+#define STORE_RATE_WINDOW 1.0 /* Seconds throughput is measured over */
+#define STORE_NATIVE_KEEPALIVE 60.0
+#define STORE_NATIVE_HEAD 128 /* Headers rendered for each request */
+#define STORE_NATIVE_READ (16 * 1024)
+#define STORE_NATIVE_LINE_MAX (8 * 1024) /* Longest line of answer head */
+
 /**
- * @brief Main structure.
+ * @brief Callbacks of one document of a batch.
  */
-struct _Store
+typedef struct _Store_Item
 {
-   const char *url; /*!< URL to store data to. */
-   const void *data; /*!< Unmodified user data attached to structure. */
-};
+   const void *data; /*!< Unmodified user data attached to document */
+   Store_Done_Cb done; /*!< Callback to call when document is stored */
+   Store_Error_Cb error; /*!< Callback to call if document is rejected */
+   size_t offset, /*!< Start of document lines in batch body */
+          len; /*!< Length of document lines */
+} Store_Item;
+
+/**
+ * @brief Documents sent together in one request.
+ *
+ * A batch either holds the NDJSON body of a _bulk request, or the
+ * single document given to store_add().
+ */
+typedef struct _Store_Batch
+{
+   Eina_Strbuf *buf; /*!< Request body */
+   Store_Item *items; /*!< Callbacks, in body order */
+   unsigned int count, /*!< Number of documents */
+                size; /*!< Allocated items */
+   Eina_Bool bulk; /*!< EINA_TRUE for a _bulk request */
+   struct _Store_Spool_Segment *segment; /*!< Segment batch was replayed from */
+   unsigned int attempts; /*!< Failed attempts to send batch */
+   double retry; /*!< When to send batch again */
+   struct _Store_Endpoint *failed; /*!< Endpoint of last failed attempt */
+   Eina_Bool failover; /*!< Another endpoint can take it right away */
+   Eina_Bool full; /*!< Sent for reaching a limit, not for lingering */
+   Eina_Bool priority; /*!< Batch of the priority lane */
+   double sent; /*!< When batch was given to the sink, 0 if it was not */
+   size_t charged; /*!< Bytes taken from rate buckets until body is posted */
+   struct _Store_Gz *gz; /*!< Compressed body, NULL if not compressed */
+} Store_Batch;
+
+/**
+ * @brief Called once the body of a batch can be sent.
+ * @param data Data given to store_gz_seal().
+ */
+typedef void (*Store_Gz_Ready_Cb)(void *data);
+
+/**
+ * @brief Compression of a batch body.
+ *
+ * The body is deflated by worker threads, one chunk at a time, while
+ * the batch is being filled. Only one job runs at a time for a batch,
+ * and only the job touches the stream and buf while it runs.
+ */
+typedef struct _Store_Gz
+{
+   z_stream z;
+   Eina_Binbuf *buf; /*!< Compressed body */
+   size_t in; /*!< Raw bytes given to jobs */
+   Store_Batch *sb; /*!< NULL once batch is freed during a job */
+
+   struct
+   {
+      Store_Gz_Ready_Cb cb; /*!< Sends batch once compressed, NULL if unsent */
+      void *data;
+   } ready;
+
+   struct
+   {
+      char *s; /*!< Copy of raw bytes, the body can grow meanwhile */
+      size_t len;
+      Eina_Bool finish; /*!< Last chunk, ending the gzip stream */
+   } chunk;
+   unsigned int jobs, /*!< Jobs started */
+                ended; /*!< Jobs ended */
+
+   Eina_Bool running, /*!< A job is compressing chunk */
+             done, /*!< buf holds the whole body */
+             error; /*!< Compression failed, send raw body */
+} Store_Gz;
+
+/**
+ * @brief Header of a batch written to the spool, followed by its body.
+ */
+typedef struct _Store_Spool_Record
+{
+   uint32_t magic, /*!< STORE_SPOOL_MAGIC */
+            len, /*!< Length of body */
+            count, /*!< Number of documents */
+            bulk; /*!< Store_Batch bulk flag */
+} Store_Spool_Record;
+
+/**
+ * @brief Append-only file of the spool.
+ */
+typedef struct _Store_Spool_Segment
+{
+   EINA_INLIST;
+   char *path;
+   size_t size; /*!< Size on disk, plus write buffer for last segment */
+   unsigned int inflight; /*!< Replayed batches not acknowledged yet */
+   Eina_Bool read; /*!< Every record has been replayed */
+} Store_Spool_Segment;
+
+/**
+ * @brief Disk spool, holding batches that can not be sent right now.
+ */
+typedef struct _Store_Spool
+{
+   const char *dir;
+   size_t max_bytes, /*!< Cap of bytes */
+          bytes; /*!< Bytes in all segments */
+   Store_Spool_Policy policy; /*!< What to do when cap is reached */
+   double replay_rate, /*!< Max replayed batches per second, 0 for no limit */
+          replay_next; /*!< When next batch can be replayed */
+   unsigned long long seq; /*!< Number of next segment */
+   unsigned long dropped; /*!< Bytes dropped because of cap */
+   Eina_Inlist *segments; /*!< Oldest first */
+
+   struct
+   {
+      int fd; /*!< Last segment, -1 if closed */
+      Eina_Binbuf *buf; /*!< Records not written yet */
+      Ecore_Timer *timer; /*!< Flushes buf */
+   } write;
+
+   struct
+   {
+      Store_Spool_Segment *segment; /*!< Segment being replayed */
+      Eina_File *f;
+      const char *map;
+      size_t size,
+             offset;
+   } read;
+} Store_Spool;
+
+/**
+ * @brief State of the HTTP sink.
+ */
+typedef struct _Store_Http
+{
+   Store *store;
+   Eina_List *endpoints; /*!< Store_Endpoint to store data to */
+} Store_Http;
+
+/**
+ * @brief State of the file and stdout sinks.
+ */
+typedef struct _Store_File
+{
+   Store *store;
+   const char *path; /*!< NULL for stdout */
+   int fd; /*!< -1 while closed */
+   size_t size, /*!< Bytes in current file */
+          max_bytes; /*!< Rotate before growing above this size */
+   double opened, /*!< When current file was opened */
+          max_age, /*!< Rotate once file is that old, negative to never */
+          sync_interval; /*!< Delay before written data is synced */
+   unsigned int seq, /*!< Rotations, tells apart files of the same second */
+                failures; /*!< Writes failed in a row */
+   double retry; /*!< When to try again after a failure */
+   Ecore_Timer *sync; /*!< Syncs written data, NULL if nothing to sync */
+} Store_File;
+
+/**
+ * @brief Where the native client is in parsing an answer.
+ */
+typedef enum _Store_Conn_Parse
+{
+   STORE_CONN_STATUS, /*!< Status line */
+   STORE_CONN_HEADERS,
+   STORE_CONN_BODY, /*!< Body of Content-Length bytes */
+   STORE_CONN_BODY_EOF, /*!< Body ending with the connection */
+   STORE_CONN_CHUNK_SIZE,
+   STORE_CONN_CHUNK_DATA,
+   STORE_CONN_CHUNK_END, /*!< Line ending chunk data */
+   STORE_CONN_TRAILERS,
+   STORE_CONN_DONE
+} Store_Conn_Parse;
+
+/**
+ * @brief Connection of the native client, sending one request at a time.
+ */
+typedef struct _Store_Conn
+{
+   struct _Store_Native *sn;
+   int fd;
+   Ecore_Fd_Handler *fdh;
+   Ecore_Timer *timer; /*!< Request timeout, or idle timeout */
+   Store_Batch *batch; /*!< Documents being sent, NULL when idle */
+   struct addrinfo *ai; /*!< Address connected to, in the list of Store_Native */
+   Eina_Bool connecting, /*!< Non-blocking connect is not over */
+             reused; /*!< Kept from a previous request */
+
+   struct
+   {
+      char head[STORE_NATIVE_HEAD]; /*!< Headers depending on the batch */
+      struct iovec iov[3]; /*!< Constant headers, head and body */
+      unsigned int first, /*!< First entry of iov left to send */
+                   count; /*!< Entries left to send, 0 once sent */
+   } out;
+
+   struct
+   {
+      Store_Conn_Parse state;
+      Eina_Strbuf *line, /*!< Line being read */
+                  *body; /*!< Answer */
+      int status; /*!< HTTP code */
+      unsigned long long left; /*!< Bytes left of body or chunk */
+      Eina_Bool started, /*!< Server sent something */
+                close, /*!< Server closes connection after answer */
+                chunked,
+                length; /*!< Content-Length was given */
+   } in;
+} Store_Conn;
+
+/**
+ * @brief Token bucket pacing requests.
+ */
+typedef struct _Store_Rate
+{
+   double limit, /*!< Bytes per second, 0 for no limit */
+          tokens, /*!< Bytes that can be sent, negative while in debt */
+          last; /*!< When tokens were last refilled */
+} Store_Rate;
+
+/**
+ * @brief State of the native HTTP/1.1 sink.
+ */
+typedef struct _Store_Native
+{
+   Store *store;
+   char *host,
+        *port,
+        *authority, /*!< host:port as given in URL, for Host header */
+        *path; /*!< Path to store single documents to */
+
+   struct
+   {
+      char *s;
+      size_t len;
+   } prefix[2]; /*!< Constant headers of single and _bulk requests */
+
+   struct addrinfo *ai; /*!< Address of server, NULL until resolved */
+   Eina_List *idle, /*!< Store_Conn kept for the next request */
+             *busy; /*!< Store_Conn sending a request */
+   Eina_Bool nodelay; /*!< Set TCP_NODELAY on connections */
+   double keepalive; /*!< How long idle connections are kept */
+   unsigned int failures; /*!< Requests failed in a row */
+   double retry; /*!< When an open breaker lets one request through */
+   Store_Rate rate; /*!< Bytes sent to the server */
+} Store_Native;
 
 /**
  * @brief Store_Add structure.
  *
- * This structure helps to manage storage of data.
+ * Handle of one HTTP request. Handles are kept by their endpoint once
+ * the request is over, so the next request reuses the connection.
  */
 typedef struct _Store_Add
 {
+   unsigned int magic; /*!< STORE_ADD_MAGIC, tells our urls from others */
    Store *store; /*!< Store structure */
+   struct _Store_Endpoint *endpoint; /*!< Endpoint owning the handle */
    Ecore_Con_Url *ec; /*!< Ecore_Con_Url structure used for storage */
+   Store_Batch *batch; /*!< Documents being sent, NULL when idle */
 
    struct
    {
       Eina_Strbuf *buf; /*!< Buffer for data reception */
-      char *sent; /*!< Data to store */
    } data;
+} Store_Add;
+
+/**
+ * @brief Server documents are sent to.
+ */
+typedef struct _Store_Endpoint
+{
+   const char *url; /*!< URL to store single documents to */
+   const char *bulk_url; /*!< URL of the _bulk endpoint */
+   Eina_List *idle; /*!< Store_Add handles ready to be reused */
+   Eina_List *busy; /*!< Store_Add handles sending a request */
+   unsigned int inflight; /*!< Requests being sent */
+   unsigned int failures; /*!< Requests failed in a row */
+   double retry; /*!< When an open breaker lets one request through */
+   Store_Rate rate; /*!< Bytes sent to the endpoint */
+} Store_Endpoint;
+
+/**
+ * @brief Tells if the circuit breaker of an endpoint is open.
+ *
+ * An open breaker only lets one probe request through at a time, once
+ * its retry time is over. A successful request closes it.
+ */
+#define STORE_ENDPOINT_OPEN(se) ((se)->failures >= STORE_BREAKER_FAILURES)
+
+/**
+ * @brief Main structure.
+ */
+struct _Store
+{
+   struct
+   {
+      const Store_Sink_Class *cls;
+      void *data; /*!< Returned by open function of cls */
+   } sink;
+   const void *data; /*!< Unmodified user data attached to structure. */
 
    struct
    {
-      const void *data; /*!< Unmodified user data attached to storage */
-      Store_Done_Cb done; /*!< Callback to call when storage is over */
-      Store_Error_Cb error; /*!< Callback to call if an error occured */
-   } cb;
+      unsigned int max_docs; /*!< Flush when batch has that many documents */
+      size_t max_bytes; /*!< Flush when batch body reaches that size */
+      double linger; /*!< Flush when first document is that old */
+      Store_Batch *current; /*!< Batch being filled */
+      Ecore_Timer *timer; /*!< Linger timer of current batch */
+   } batch;
 
    struct
    {
-      Ecore_Event_Handler *ed, /*!< Event handler for data reception */
-                          *ec; /*!< Event handler for complete http query */
-   } ev;
-} Store_Add;
+      unsigned int max_docs, /*!< Flush when batch has that many documents */
+                   max_inflight, /*!< Requests of this lane sent at once */
+                   inflight; /*!< Requests of this lane being sent */
+      double linger; /*!< Flush when first document is that old */
+      Store_Batch *current; /*!< Batch being filled */
+      Ecore_Timer *timer; /*!< Linger timer of current batch */
+      Eina_List *pending; /*!< FIFO of Store_Batch waiting for a slot */
+      Eina_List *retry; /*!< Failed Store_Batch, by retry time */
+      unsigned int pending_count; /*!< Batches in pending and retry lists */
+   } priority; /*!< Lane bypassing the spool and the queue of batches */
+
+   struct
+   {
+      unsigned int max_inflight, /*!< Max requests sent at once */
+                   inflight; /*!< Requests sent, without priority ones */
+      Eina_List *pending; /*!< FIFO of Store_Batch waiting for a handle */
+      Eina_List *retry; /*!< Failed Store_Batch, by retry time */
+      unsigned int pending_count; /*!< Batches in pending and retry lists */
+      size_t bytes; /*!< Bytes of pending and in flight batches */
+      Ecore_Timer *timer; /*!< Runs queue once endpoint or replay can go */
+      double when; /*!< When timer expires */
+      Eina_Bool running, /*!< store_queue_run() is sending batches */
+                stopped; /*!< Store is being freed, nothing is sent */
+   } queue;
+
+   struct
+   {
+      unsigned int attempts; /*!< Max attempts before spooling a batch */
+      double delay, /*!< Delay after first failure */
+             max_delay; /*!< Cap of exponential delay */
+   } retry;
+
+   struct
+   {
+      size_t high_bytes, /*!< Throttle above this many bytes in memory */
+             low_bytes; /*!< Stop throttling below this many bytes */
+      unsigned int high_batches, /*!< Throttle above this many pending batches */
+                   low_batches; /*!< Stop throttling below this many */
+      Store_Throttle_Cb cb; /*!< Tells the app to stop or resume reading */
+      const void *data; /*!< Data of cb */
+      Eina_Bool on; /*!< Currently throttled */
+      unsigned long count; /*!< Times throttling started */
+      double start, /*!< When throttling started */
+             time; /*!< Time spent throttled before start */
+   } throttle;
+
+   struct
+   {
+      Store_Compress type;
+      int level; /*!< zlib compression level */
+   } compress;
+
+   struct
+   {
+      double target, /*!< Target latency of requests, 0 when disabled */
+             scale, /*!< Share of batch limits in use, up to 1 */
+             window, /*!< Requests allowed in flight, up to max_inflight */
+             latency, /*!< Moving average of request latency */
+             doc_cost, /*!< Moving average of latency per document */
+             cut; /*!< When limits were last cut */
+      unsigned long increases, /*!< Times scale or window grew */
+                    decreases; /*!< Times scale or window was cut */
+   } adapt;
+
+   struct
+   {
+      Store_Rate global; /*!< Bytes sent to all endpoints */
+      double endpoint; /*!< Limit of each endpoint, 0 for no limit */
+      unsigned long long total; /*!< Bytes sent */
+      size_t window; /*!< Bytes sent since start */
+      double start, /*!< When the measure window started */
+             measured; /*!< Bytes per second of the last window */
+      unsigned long paced; /*!< Times a request waited for its bytes */
+   } rate;
+
+   Store_Spool *spool; /*!< NULL if no spool is set */
+};
 
 void store_add_free(Store_Add *sa);
 
+void store_queue_push(Store *store, Store_Batch *sb);
+void store_queue_run(Store *store);
+Eina_Bool store_request_failed(int http_code);
+void store_throttle_check(Store *store);
+
+void store_http_done(Store_Add *sa, int http_code);
+
+void store_spool_free(Store_Spool *sp);
+Eina_Bool store_spool_write(Store_Spool *sp, Store_Batch *sb);
+Store_Batch * store_spool_read(Store_Spool *sp);
+Eina_Bool store_spool_has_data(Store_Spool *sp);
+void store_spool_release(Store_Spool *sp, Store_Spool_Segment *seg);
+
+Store_Batch * store_batch_new(Eina_Bool bulk);
+Store_Item * store_batch_item_add(Store_Batch *sb);
+void store_batch_free(Store_Batch *sb);
+void store_batch_error(Store_Batch *sb, Store *store, const char *errstr);
+void store_batch_complete(Store *store, Store_Batch *sb, int http_code, char *answer, size_t len);
+void store_batch_retry(Store *store, Store_Batch *sb, int http_code);
+
+void store_adapt_done(Store *store, Store_Batch *sb, int http_code);
+unsigned int store_adapt_docs(Store *store);
+size_t store_adapt_bytes(Store *store);
+double store_adapt_linger(Store *store);
+unsigned int store_adapt_inflight(Store *store);
+
+void store_rate_limit_set(Store_Rate *sr, double limit);
+double store_rate_when(Store_Rate *sr);
+void store_rate_take(Store_Rate *sr, double bytes);
+void store_rate_start(Store *store, Store_Batch *sb);
+void store_rate_sent(Store *store, Store_Rate *sr, Store_Batch *sb, size_t bytes);
+double store_rate_measured(Store *store);
+
+void store_gz_feed(Store *store, Store_Batch *sb);
+Eina_Bool store_gz_seal(Store *store, Store_Batch *sb, Store_Gz_Ready_Cb cb, void *data);
+void store_gz_free(Store_Gz *gz);
+
 Eina_Bool store_event_data(void *data, int type, void *event_info);
 Eina_Bool store_event_complete(void *data, int type, void *event_info);
 
 char * store_utils_dupf(const char *s, ...);
+double store_utils_backoff(double delay, double max_delay, unsigned int attempt);
 
 /**
  * @endcond
@@ -0,0 +1,209 @@
+#include "store_private.h"
+
+/**
+ * @addtogroup Lib-Store-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+static void
+_store_rate_refill(Store_Rate *sr,
+                   double now)
+{
+   sr->tokens += (now - sr->last) * sr->limit;
+   if (sr->tokens > sr->limit * STORE_RATE_BURST)
+     sr->tokens = sr->limit * STORE_RATE_BURST;
+   sr->last = now;
+}
+
+/**
+ * @brief Set the limit of a token bucket.
+ * @param sr Store_Rate structure.
+ * @param limit Bytes per second, 0 for no limit.
+ *
+ * The bucket starts full, holding STORE_RATE_BURST seconds of bytes.
+ */
+void
+store_rate_limit_set(Store_Rate *sr,
+                     double limit)
+{
+   sr->limit = (limit > 0.0) ? limit : 0.0;
+   sr->tokens = sr->limit * STORE_RATE_BURST;
+   sr->last = ecore_time_get();
+}
+
+/**
+ * @brief Tells when a request can start.
+ * @param sr Store_Rate structure.
+ * @return 0 if a request can start now, the ecore_time_get() time it
+ *         can start at otherwise.
+ *
+ * A request starts as long as the bucket is not in debt, whatever its
+ * size, so that requests bigger than the bucket still go. The debt it
+ * leaves delays the next ones, which paces requests at the limit.
+ */
+double
+store_rate_when(Store_Rate *sr)
+{
+   double now;
+
+   if (sr->limit <= 0.0)
+     return 0.0;
+
+   now = ecore_time_get();
+   _store_rate_refill(sr, now);
+   if (sr->tokens >= 0.0)
+     return 0.0;
+   return now - sr->tokens / sr->limit;
+}
+
+/**
+ * @brief Takes the bytes of a starting request from a bucket.
+ * @param sr Store_Rate structure.
+ * @param bytes Bytes of the request, negative to give bytes back.
+ */
+void
+store_rate_take(Store_Rate *sr,
+                double bytes)
+{
+   if (sr->limit <= 0.0)
+     return;
+
+   _store_rate_refill(sr, ecore_time_get());
+   sr->tokens -= bytes;
+   if (sr->tokens > sr->limit * STORE_RATE_BURST)
+     sr->tokens = sr->limit * STORE_RATE_BURST;
+}
+
+/**
+ * @brief Takes the raw body of a starting request from the global bucket.
+ * @param store Store structure.
+ * @param sb Batch given to the sink.
+ *
+ * The compressed size is only known once the body is posted, so
+ * requests are charged for their raw body when they start, keeping
+ * requests started together from being charged late. Sinks charge the
+ * bucket of their endpoint with sb->charged the same way.
+ */
+void
+store_rate_start(Store *store,
+                 Store_Batch *sb)
+{
+   sb->charged = eina_strbuf_length_get(sb->buf);
+   store_rate_take(&store->rate.global, sb->charged);
+}
+
+/**
+ * @brief Accounts for bytes a sink sends.
+ * @param store Store structure.
+ * @param sr Bucket of the endpoint they go to, NULL for none.
+ * @param sb Batch being sent.
+ * @param bytes Bytes of body, compressed if it is, 0 if the request
+ *        failed before its body was sent.
+ *
+ * Sinks call it once the body is final. Buckets are charged for what
+ * the start of the request did not take, or given back what it took
+ * above @p bytes, in which case waiting requests may start now.
+ * Throughput is measured over windows of STORE_RATE_WINDOW seconds.
+ */
+void
+store_rate_sent(Store *store,
+                Store_Rate *sr,
+                Store_Batch *sb,
+                size_t bytes)
+{
+   double now = ecore_time_get(),
+          delta = (double)bytes - (double)sb->charged;
+
+   sb->charged = 0;
+   store_rate_take(&store->rate.global, delta);
+   if (sr)
+     store_rate_take(sr, delta);
+   store->rate.total += bytes;
+
+   if (now - store->rate.start >= STORE_RATE_WINDOW)
+     {
+        store->rate.measured = (store->rate.start > 0.0) ?
+           store->rate.window / (now - store->rate.start) : 0.0;
+        store->rate.start = now;
+        store->rate.window = 0;
+     }
+   store->rate.window += bytes;
+
+   if ((bytes) && (delta < 0.0))
+     store_queue_run(store);
+}
+
+/**
+ * @brief Measured throughput.
+ * @param store Store structure.
+ * @return Bytes per second sent over the last window.
+ *
+ * Without requests for a while, the window being filled is used, so
+ * that the throughput drops once nothing is sent.
+ */
+double
+store_rate_measured(Store *store)
+{
+   double elapsed = ecore_time_get() - store->rate.start;
+
+   if ((store->rate.start > 0.0) && (elapsed >= 2 * STORE_RATE_WINDOW))
+     return store->rate.window / elapsed;
+   return store->rate.measured;
+}
+
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Set how many bytes per second can be sent.
+ * @param store Store structure.
+ * @param limit Max bytes per second sent to all endpoints, 0 for no
+ *        limit.
+ * @param endpoint_limit Max bytes per second sent to each endpoint, 0
+ *        for no limit.
+ *
+ * Requests are paced by token buckets : a request starts once the
+ * bytes of previous requests are paid for, while batches wait in
+ * memory, so that throttling tells the app to stop reading if pacing
+ * lasts. Buckets hold one second of bytes, allowing short bursts.<br />
+ * Bytes are counted as sent on the wire : a request is charged its raw
+ * body when it starts, then its compressed body once it is posted.
+ * Requests of the priority lane are counted, but never wait.
+ */
+void
+store_rate_set(Store *store,
+               double limit,
+               double endpoint_limit)
+{
+   Store_Endpoint *se;
+   Eina_List *l;
+
+   EINA_SAFETY_ON_NULL_RETURN(store);
+
+   store_rate_limit_set(&store->rate.global, limit);
+   store->rate.endpoint = (endpoint_limit > 0.0) ? endpoint_limit : 0.0;
+
+   if (store->sink.cls == &store_sink_http)
+     {
+        Store_Http *sh = store->sink.data;
+
+        EINA_LIST_FOREACH(sh->endpoints, l, se)
+          store_rate_limit_set(&se->rate, store->rate.endpoint);
+     }
+   else if (store->sink.cls == &store_sink_native)
+     {
+        Store_Native *sn = store->sink.data;
+
+        store_rate_limit_set(&sn->rate, store->rate.endpoint);
+     }
+   store_queue_run(store);
+}
+
+/**
+ * @}
+ */
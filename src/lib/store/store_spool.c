@@ -0,0 +1,570 @@
+#include "store_private.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @addtogroup Lib-Store-Functions
+ * @{
+ */
+
+/**
+ * @cond IGNORE
+ */
+
+static void
+_store_spool_segment_free(Store_Spool_Segment *seg)
+{
+   free(seg->path);
+   free(seg);
+}
+
+static Store_Spool_Segment *
+_store_spool_segment_last(Store_Spool *sp)
+{
+   Eina_Inlist *l = sp->segments;
+
+   if (!l)
+     return NULL;
+   if (l->last)
+     l = l->last;
+   return EINA_INLIST_CONTAINER_GET(l, Store_Spool_Segment);
+}
+
+/**
+ * @brief Writes buffered records to the last segment.
+ * @param sp Store_Spool structure.
+ */
+static void
+_store_spool_flush(Store_Spool *sp)
+{
+   const unsigned char *p;
+   size_t len;
+   ssize_t r;
+
+   p = eina_binbuf_string_get(sp->write.buf);
+   len = eina_binbuf_length_get(sp->write.buf);
+   if ((!len) || (sp->write.fd < 0))
+     return;
+
+   while (len)
+     {
+        r = write(sp->write.fd, p, len);
+        if (r < 0)
+          {
+             if (errno == EINTR)
+               continue;
+             ERR("Failed to write to spool : %s", strerror(errno));
+             break;
+          }
+        p += r;
+        len -= r;
+     }
+
+   if (fdatasync(sp->write.fd))
+     ERR("Failed to sync spool : %s", strerror(errno));
+   eina_binbuf_reset(sp->write.buf);
+}
+
+static Eina_Bool
+_store_spool_flush_timer(void *data)
+{
+   Store_Spool *sp = data;
+
+   sp->write.timer = NULL;
+   _store_spool_flush(sp);
+   return EINA_FALSE;
+}
+
+/**
+ * @brief Closes the last segment, next write opens a new one.
+ * @param sp Store_Spool structure.
+ */
+static void
+_store_spool_rotate(Store_Spool *sp)
+{
+   if (sp->write.fd < 0)
+     return;
+
+   _store_spool_flush(sp);
+   close(sp->write.fd);
+   sp->write.fd = -1;
+}
+
+static Store_Spool_Segment *
+_store_spool_segment_add(Store_Spool *sp,
+                         const char *path,
+                         size_t size)
+{
+   Store_Spool_Segment *seg;
+
+   seg = calloc(1, sizeof(Store_Spool_Segment));
+   if (!seg)
+     return NULL;
+
+   seg->path = strdup(path);
+   seg->size = size;
+   sp->bytes += size;
+   sp->segments = eina_inlist_append(sp->segments, EINA_INLIST_GET(seg));
+   return seg;
+}
+
+static Eina_Bool
+_store_spool_open(Store_Spool *sp)
+{
+   char *path;
+
+   path = store_utils_dupf("%s/%016llx.spool", sp->dir, sp->seq++);
+   if (!path)
+     return EINA_FALSE;
+
+   sp->write.fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+   if (sp->write.fd < 0)
+     {
+        ERR("Failed to open %s : %s", path, strerror(errno));
+        free(path);
+        return EINA_FALSE;
+     }
+
+   if (!_store_spool_segment_add(sp, path, 0))
+     {
+        close(sp->write.fd);
+        sp->write.fd = -1;
+        unlink(path);
+        free(path);
+        return EINA_FALSE;
+     }
+
+   DBG("Opened spool segment %s", path);
+   free(path);
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Removes a segment once it has been replayed and acknowledged,
+ *        or when it is dropped.
+ * @param sp Store_Spool structure.
+ * @param seg Segment to remove.
+ */
+static void
+_store_spool_segment_del(Store_Spool *sp,
+                         Store_Spool_Segment *seg)
+{
+   if (seg == _store_spool_segment_last(sp))
+     _store_spool_rotate(sp);
+
+   DBG("Removing spool segment %s", seg->path);
+   unlink(seg->path);
+   sp->bytes -= seg->size;
+   sp->segments = eina_inlist_remove(sp->segments, EINA_INLIST_GET(seg));
+   _store_spool_segment_free(seg);
+}
+
+static void
+_store_spool_read_close(Store_Spool *sp)
+{
+   Store_Spool_Segment *seg = sp->read.segment;
+
+   if (!seg)
+     return;
+
+   eina_file_map_free(sp->read.f, (void *)sp->read.map);
+   eina_file_close(sp->read.f);
+   memset(&sp->read, 0, sizeof(sp->read));
+
+   seg->read = EINA_TRUE;
+   if (!seg->inflight)
+     _store_spool_segment_del(sp, seg);
+}
+
+static Eina_Bool
+_store_spool_read_open(Store_Spool *sp)
+{
+   Store_Spool_Segment *seg;
+
+   EINA_INLIST_FOREACH(sp->segments, seg)
+     {
+        if (!seg->read)
+          break;
+     }
+   if (!seg)
+     return EINA_FALSE;
+
+   /* Last segment is only replayed once it is closed */
+   if (seg == _store_spool_segment_last(sp))
+     {
+        if (!seg->size)
+          return EINA_FALSE;
+        _store_spool_rotate(sp);
+     }
+
+   sp->read.f = eina_file_open(seg->path, EINA_FALSE);
+   if (!sp->read.f)
+     {
+        ERR("Failed to open %s, dropping it", seg->path);
+        sp->dropped += seg->size;
+        _store_spool_segment_del(sp, seg);
+        return EINA_FALSE;
+     }
+
+   sp->read.size = eina_file_size_get(sp->read.f);
+   sp->read.map = eina_file_map_all(sp->read.f, EINA_FILE_SEQUENTIAL);
+   if ((!sp->read.map) && (sp->read.size))
+     {
+        ERR("Failed to map %s, dropping it", seg->path);
+        eina_file_close(sp->read.f);
+        memset(&sp->read, 0, sizeof(sp->read));
+        sp->dropped += seg->size;
+        _store_spool_segment_del(sp, seg);
+        return EINA_FALSE;
+     }
+
+   sp->read.segment = seg;
+   sp->read.offset = 0;
+   DBG("Replaying spool segment %s", seg->path);
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Makes room for @p len bytes, according to policy.
+ * @param sp Store_Spool structure.
+ * @param len Bytes to write.
+ * @return EINA_FALSE if batch has to stay in memory.
+ */
+static Eina_Bool
+_store_spool_room(Store_Spool *sp,
+                  size_t len)
+{
+   Store_Spool_Segment *seg;
+
+   while (sp->bytes + len > sp->max_bytes)
+     {
+        if (sp->policy == STORE_SPOOL_BACKPRESSURE)
+          return EINA_FALSE;
+
+        EINA_INLIST_FOREACH(sp->segments, seg)
+          {
+             if ((!seg->read) && (seg != sp->read.segment))
+               break;
+          }
+
+        if (seg)
+          {
+             WRN("Spool full, dropping %zu bytes from %s",
+                 seg->size, seg->path);
+             sp->dropped += seg->size;
+             _store_spool_segment_del(sp, seg);
+             continue;
+          }
+
+        /* Only the segment being replayed is left, skip its records */
+        if ((sp->read.segment) && (sp->read.offset < sp->read.size))
+          {
+             WRN("Spool full, skipping %zu bytes of %s",
+                 sp->read.size - sp->read.offset, sp->read.segment->path);
+             sp->dropped += sp->read.size - sp->read.offset;
+             sp->read.offset = sp->read.size;
+          }
+        break;
+     }
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Frees a spool, keeping its segments on disk.
+ * @param sp Store_Spool structure.
+ */
+void
+store_spool_free(Store_Spool *sp)
+{
+   Store_Spool_Segment *seg;
+
+   if (sp->write.timer) ecore_timer_del(sp->write.timer);
+   _store_spool_rotate(sp);
+
+   if (sp->read.f)
+     {
+        eina_file_map_free(sp->read.f, (void *)sp->read.map);
+        eina_file_close(sp->read.f);
+     }
+
+   while (sp->segments)
+     {
+        seg = EINA_INLIST_CONTAINER_GET(sp->segments, Store_Spool_Segment);
+        sp->segments = eina_inlist_remove(sp->segments, sp->segments);
+        _store_spool_segment_free(seg);
+     }
+
+   eina_binbuf_free(sp->write.buf);
+   eina_stringshare_del(sp->dir);
+   free(sp);
+}
+
+/**
+ * @brief Appends a batch to the spool.
+ * @param sp Store_Spool structure.
+ * @param sb Batch to write, caller still owns it.
+ * @return EINA_TRUE if batch is spooled, EINA_FALSE otherwise.
+ *
+ * Records are buffered, and written once the buffer is big enough or
+ * STORE_SPOOL_FLUSH seconds later, or when the spool is freed.
+ */
+Eina_Bool
+store_spool_write(Store_Spool *sp,
+                  Store_Batch *sb)
+{
+   Store_Spool_Record rec;
+   Store_Spool_Segment *seg;
+   size_t len;
+
+   len = eina_strbuf_length_get(sb->buf);
+   if (!_store_spool_room(sp, sizeof(rec) + len))
+     return EINA_FALSE;
+
+   if ((sp->write.fd < 0) && (!_store_spool_open(sp)))
+     return EINA_FALSE;
+   seg = _store_spool_segment_last(sp);
+
+   rec.magic = STORE_SPOOL_MAGIC;
+   rec.len = len;
+   rec.count = sb->count;
+   rec.bulk = sb->bulk;
+   eina_binbuf_append_length(sp->write.buf, (unsigned char *)&rec, sizeof(rec));
+   eina_binbuf_append_length(sp->write.buf,
+                             (unsigned char *)eina_strbuf_string_get(sb->buf),
+                             len);
+   seg->size += sizeof(rec) + len;
+   sp->bytes += sizeof(rec) + len;
+
+   if (eina_binbuf_length_get(sp->write.buf) >= STORE_SPOOL_WRITE_SIZE)
+     _store_spool_flush(sp);
+   else if (!sp->write.timer)
+     sp->write.timer = ecore_timer_add(STORE_SPOOL_FLUSH,
+                                       _store_spool_flush_timer, sp);
+
+   if (seg->size >= STORE_SPOOL_SEGMENT_SIZE)
+     _store_spool_rotate(sp);
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Tells if spool has batches to replay.
+ * @param sp Store_Spool structure.
+ * @return EINA_TRUE if store_spool_read() has something to give.
+ */
+Eina_Bool
+store_spool_has_data(Store_Spool *sp)
+{
+   Store_Spool_Segment *seg;
+
+   if ((sp->read.segment) && (sp->read.offset < sp->read.size))
+     return EINA_TRUE;
+
+   EINA_INLIST_FOREACH(sp->segments, seg)
+     {
+        if ((!seg->read) && (seg != sp->read.segment) && (seg->size))
+          return EINA_TRUE;
+     }
+   return EINA_FALSE;
+}
+
+/**
+ * @brief Reads the oldest batch of the spool.
+ * @param sp Store_Spool structure.
+ * @return Batch to send, NULL if spool is empty.
+ *
+ * The batch keeps its segment on disk until store_spool_release() is
+ * called for it. Documents replayed have no callbacks.
+ */
+Store_Batch *
+store_spool_read(Store_Spool *sp)
+{
+   Store_Spool_Record rec;
+   Store_Batch *sb;
+   Store_Item *si;
+   const char *body,
+              *p;
+   size_t off;
+   unsigned int i;
+
+   while (1)
+     {
+        if ((!sp->read.segment) && (!_store_spool_read_open(sp)))
+          return NULL;
+
+        if (sp->read.offset + sizeof(rec) > sp->read.size)
+          {
+             _store_spool_read_close(sp);
+             continue;
+          }
+
+        memcpy(&rec, sp->read.map + sp->read.offset, sizeof(rec));
+        if ((rec.magic != STORE_SPOOL_MAGIC) ||
+            (rec.len > sp->read.size - sp->read.offset - sizeof(rec)))
+          {
+             ERR("Corrupted record in %s at offset %zu, skipping segment",
+                 sp->read.segment->path, sp->read.offset);
+             sp->dropped += sp->read.size - sp->read.offset;
+             _store_spool_read_close(sp);
+             continue;
+          }
+        break;
+     }
+
+   sb = store_batch_new(!!rec.bulk);
+   if (!sb)
+     return NULL;
+
+   body = sp->read.map + sp->read.offset + sizeof(rec);
+   eina_strbuf_append_length(sb->buf, body, rec.len);
+   for (i = 0, off = 0; i < rec.count; i++)
+     {
+        si = store_batch_item_add(sb);
+        if (!si)
+          {
+             store_batch_free(sb);
+             return NULL;
+          }
+
+        /* A _bulk document is an action line and a source line */
+        si->offset = off;
+        p = (rec.bulk) ? memchr(body + off, '\n', rec.len - off) : NULL;
+        if (p)
+          p = memchr(p + 1, '\n', body + rec.len - p - 1);
+        si->len = (p) ? (size_t)(p + 1 - body) - off : rec.len - off;
+        off += si->len;
+     }
+   sp->read.offset += sizeof(rec) + rec.len;
+
+   sb->segment = sp->read.segment;
+   sb->segment->inflight++;
+
+   if (sp->read.offset >= sp->read.size)
+     _store_spool_read_close(sp);
+   return sb;
+}
+
+/**
+ * @brief Acknowledges a replayed batch.
+ * @param sp Store_Spool structure.
+ * @param seg Segment the batch was read from.
+ *
+ * The segment is removed once all its batches are acknowledged.
+ */
+void
+store_spool_release(Store_Spool *sp,
+                    Store_Spool_Segment *seg)
+{
+   seg->inflight--;
+   if ((seg->read) && (!seg->inflight))
+     _store_spool_segment_del(sp, seg);
+}
+
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Set a disk spool for batches that can not be sent right now.
+ * @param store Store structure.
+ * @param dir Directory of the spool, created if needed.
+ * @param max_bytes Max size of the spool.
+ * @param policy What to do when spool is full.
+ * @param replay_rate Max batches replayed per second, 0 for no limit.
+ * @return EINA_TRUE if spool is set, EINA_FALSE otherwise.
+ *
+ * Batches go to the spool when the breaker of the endpoint is open,
+ * when they run out of attempts (see store_retry_set()), or when
+ * max_inflight requests are sent and as many batches are waiting. Once
+ * in the spool, they are replayed in order, and removed once the server
+ * acknowledged them. Segments left by a previous run are replayed too.<br />
+ * Spooled batches are written and synced to disk at most 0.5 seconds
+ * later, so a crash loses the batches spooled within the last half
+ * second. store_free() writes them all, along with the batches not sent
+ * yet.<br />
+ * Callbacks of spooled documents are not called.
+ */
+Eina_Bool
+store_spool_set(Store *store,
+                const char *dir,
+                size_t max_bytes,
+                Store_Spool_Policy policy,
+                double replay_rate)
+{
+   Store_Spool *sp;
+   Eina_Iterator *it;
+   Eina_List *files = NULL;
+   const char *file;
+   struct stat st;
+   char *end;
+   unsigned long long seq;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(store, EINA_FALSE);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(dir, EINA_FALSE);
+   EINA_SAFETY_ON_TRUE_RETURN_VAL(!!store->spool, EINA_FALSE);
+
+   if ((mkdir(dir, 0700)) && (errno != EEXIST))
+     {
+        ERR("Failed to create spool directory %s : %s", dir, strerror(errno));
+        return EINA_FALSE;
+     }
+
+   sp = calloc(1, sizeof(Store_Spool));
+   if (!sp)
+     {
+        ERR("Failed to allocate Store_Spool structure");
+        return EINA_FALSE;
+     }
+
+   sp->dir = eina_stringshare_add(dir);
+   sp->max_bytes = max_bytes;
+   sp->policy = policy;
+   sp->replay_rate = replay_rate;
+   sp->write.fd = -1;
+   sp->write.buf = eina_binbuf_new();
+   if ((!sp->dir) || (!sp->write.buf))
+     {
+        ERR("Failed to allocate spool");
+        store_spool_free(sp);
+        return EINA_FALSE;
+     }
+
+   it = eina_file_ls(dir);
+   if (it)
+     {
+        while (eina_iterator_next(it, (void **)&file))
+          {
+             if (eina_str_has_extension(file, ".spool"))
+               files = eina_list_append(files, file);
+             else
+               eina_stringshare_del(file);
+          }
+        eina_iterator_free(it);
+     }
+
+   /* Names are fixed width hexadecimal numbers, sorting keeps order */
+   files = eina_list_sort(files, 0, EINA_COMPARE_CB(strcmp));
+   EINA_LIST_FREE(files, file)
+     {
+        seq = strtoull(strrchr(file, '/') + 1, &end, 16);
+        if ((!stat(file, &st)) && (*end == '.'))
+          {
+             if (seq >= sp->seq)
+               sp->seq = seq + 1;
+             DBG("Found spool segment %s, %lld bytes",
+                 file, (long long)st.st_size);
+             _store_spool_segment_add(sp, file, st.st_size);
+          }
+        eina_stringshare_del(file);
+     }
+
+   store->spool = sp;
+   store_queue_run(store);
+   return EINA_TRUE;
+}
+
+/**
+ * @}
+ */
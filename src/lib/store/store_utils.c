@@ -1,5 +1,8 @@
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "store_private.h"
 
@@ -36,6 +39,35 @@ store_utils_dupf(const char *s, ...)
    return str;
 }
 
+/**
+ * @brief Computes the delay before the next attempt of something failing.
+ * @param delay Delay after the first failure.
+ * @param max_delay Cap of the delay.
+ * @param attempt Number of failures in a row, starting at 1.
+ * @return Random delay between half and all of delay * 2^(attempt - 1),
+ *         capped to max_delay.
+ *
+ * Jitter keeps clients that failed at the same time from trying again
+ * all at once.
+ */
+double
+store_utils_backoff(double delay,
+                    double max_delay,
+                    unsigned int attempt)
+{
+   static unsigned int seed = 0;
+
+   if (!seed)
+     seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+
+   while ((attempt-- > 1) && (delay < max_delay))
+     delay *= 2;
+   if (delay > max_delay)
+     delay = max_delay;
+
+   return delay / 2 + delay / 2 * ((double)rand_r(&seed) / RAND_MAX);
+}
+
 /**
  * @endcond
  */